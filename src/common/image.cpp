@@ -3,6 +3,49 @@
 namespace tensor
 {
 
-tensor::Image cvimg(const cv::Mat &image) { return Image(image.data, image.cols, image.rows); }
+// roi views and padded buffers keep their row step, no clone() needed
+tensor::Image cvimg(const cv::Mat &image)
+{
+    PixelFormat format = PixelFormat::BGR;
+    if (image.channels() == 1) format = PixelFormat::GRAY;
+    else if (image.channels() == 4) format = PixelFormat::BGRA;
+    return Image(image.data, image.cols, image.rows, format, (int)image.step[0]);
+}
+
+Image Image::nv12(const void *y, int y_stride, const void *uv, int uv_stride, int width, int height)
+{
+    Image image(y, width, height, PixelFormat::NV12, y_stride);
+    image.planes[1]  = uv;
+    image.strides[1] = uv_stride;
+    return image;
+}
+
+Image Image::i420(const void *y, int y_stride, const void *u, int u_stride, const void *v, int v_stride,
+                  int width, int height)
+{
+    Image image(y, width, height, PixelFormat::I420, y_stride);
+    image.planes[1]  = u;
+    image.strides[1] = u_stride;
+    image.planes[2]  = v;
+    image.strides[2] = v_stride;
+    return image;
+}
+
+int Image::row_bytes(int plane) const
+{
+    int chroma_width = (width + 1) / 2;
+    switch (format)
+    {
+    case PixelFormat::BGR:
+    case PixelFormat::RGB:  return width * 3;
+    case PixelFormat::BGRA: return width * 4;
+    case PixelFormat::GRAY: return width;
+    case PixelFormat::NV12: return plane == 0 ? width : chroma_width * 2;
+    case PixelFormat::I420: return plane == 0 ? width : chroma_width;
+    }
+    return 0;
+}
+
+int Image::plane_rows(int plane) const { return plane == 0 ? height : (height + 1) / 2; }
 
 } // namespace tensor
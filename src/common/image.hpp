@@ -5,13 +5,52 @@
 namespace tensor
 {
 
+// layout of the caller's frame. NV12 and I420 are yuv 4:2:0 (bt.601 video range) as hardware decoders give them,
+// they are converted to BGR while the frame is sliced
+enum class PixelFormat : int
+{
+    BGR  = 0,
+    RGB  = 1,
+    BGRA = 2,
+    GRAY = 3,
+    NV12 = 4,  // Y plane, then one plane of interleaved U, V at half resolution
+    I420 = 5   // Y plane, U plane, V plane, chroma at half resolution
+};
+
 struct Image
 {
-    const void *bgrptr = nullptr;
+    // planes[0] is the packed pixels or the luma plane, planes[1] and planes[2] the chroma planes
+    const void *planes[3] = {nullptr, nullptr, nullptr};
+    // bytes between rows of every plane, 0 for tightly packed rows
+    int strides[3] = {0, 0, 0};
     int width = 0, height = 0;
+    PixelFormat format = PixelFormat::BGR;
 
     Image() = default;
-    Image(const void *bgrptr, int width, int height) : bgrptr(bgrptr), width(width), height(height) {}
+    Image(const void *bgrptr, int width, int height) : width(width), height(height) { planes[0] = bgrptr; }
+    Image(const void *data, int width, int height, PixelFormat format, int stride = 0)
+        : width(width), height(height), format(format)
+    {
+        planes[0]  = data;
+        strides[0] = stride;
+    }
+
+    static Image nv12(const void *y, int y_stride, const void *uv, int uv_stride, int width, int height);
+    static Image i420(const void *y, int y_stride, const void *u, int u_stride, const void *v, int v_stride,
+                      int width, int height);
+
+    // the packed pixels of a single plane frame, what the bgrptr member held before the planes
+    inline const void *bgrptr() const { return planes[0]; }
+
+    inline int num_planes() const { return format == PixelFormat::NV12 ? 2 : (format == PixelFormat::I420 ? 3 : 1); }
+
+    // bytes of one row of pixels in the plane, without padding
+    int row_bytes(int plane) const;
+
+    // strides[plane], or row_bytes(plane) when it is 0
+    inline int line_size(int plane) const { return strides[plane] > 0 ? strides[plane] : row_bytes(plane); }
+
+    int plane_rows(int plane) const;
 };
 
 Image cvimg(const cv::Mat &image);
@@ -242,6 +242,18 @@ class EngineImplement : public Engine {
     return std::vector<int>(dim.d, dim.d + dim.nbDims);
   }
 
+  virtual std::vector<int> max_dims(const std::string &name) override { return max_dims(index(name)); }
+
+  virtual std::vector<int> max_dims(int ibinding) override {
+    auto engine = this->context_->engine_;
+    auto name = engine->getIOTensorName(ibinding);
+    if (engine->getTensorIOMode(name) != nvinfer1::TensorIOMode::kINPUT) return static_dims(ibinding);
+
+    auto dim = engine->getProfileShape(name, 0, nvinfer1::OptProfileSelector::kMAX);
+    if (dim.nbDims <= 0) return static_dims(ibinding);
+    return std::vector<int>(dim.d, dim.d + dim.nbDims);
+  }
+
   virtual int num_bindings() override { return this->context_->engine_->getNbIOTensors(); }
 
   virtual bool is_input(int ibinding) override { 
@@ -183,6 +183,21 @@ public:
         return std::vector<int>(dim.d, dim.d + dim.nbDims);
     }
 
+    virtual std::vector<int> max_dims(const std::string &name) override 
+    {
+        return max_dims(index(name));
+    }
+
+    virtual std::vector<int> max_dims(int ibinding) override 
+    {
+        auto engine = this->context_->engine_;
+        if (!engine->bindingIsInput(ibinding)) return static_dims(ibinding);
+
+        auto dim = engine->getProfileDimensions(ibinding, 0, OptProfileSelector::kMAX);
+        if (dim.nbDims <= 0) return static_dims(ibinding);
+        return std::vector<int>(dim.d, dim.d + dim.nbDims);
+    }
+
     virtual int num_bindings() override { return this->context_->engine_->getNbBindings(); }
 
     virtual bool is_input(int ibinding) override 
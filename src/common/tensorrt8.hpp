@@ -18,6 +18,9 @@ public:
     virtual std::vector<int> run_dims(int ibinding) = 0;
     virtual std::vector<int> static_dims(const std::string &name) = 0;
     virtual std::vector<int> static_dims(int ibinding) = 0;
+    // upper bound of the optimization profile, equal to static_dims for static bindings
+    virtual std::vector<int> max_dims(const std::string &name) = 0;
+    virtual std::vector<int> max_dims(int ibinding) = 0;
     virtual int numel(const std::string &name) = 0;
     virtual int numel(int ibinding) = 0;
     virtual int num_bindings() = 0;
@@ -1,5 +1,6 @@
 #include <sstream>
 #include <iostream>
+#include <cstring>
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 #include <pybind11/stl_bind.h>
@@ -68,7 +69,34 @@ public:
             throw std::logic_error("Unsupported type, only support uchar, int32, float");
             return false;
         }
-        value = cv::Mat(nh, nw, dtype, info.ptr);
+        // rows may be strided (roi views, frame[::2]), pixels and channels inside a row must be contiguous.
+        // anything else (frame[:, ::2], flipped arrays) is copied into a contiguous Mat
+        ssize_t elemsize = info.itemsize;
+        bool contiguous_rows = info.strides[0] >= (ssize_t)nw * nc * elemsize;
+        if (ndims == 3) contiguous_rows = contiguous_rows && info.strides[1] == nc * elemsize && info.strides[2] == elemsize;
+        else contiguous_rows = contiguous_rows && info.strides[1] == elemsize;
+
+        if (contiguous_rows)
+        {
+            value = cv::Mat(nh, nw, dtype, info.ptr, (size_t)info.strides[0]);
+        }
+        else
+        {
+            value = cv::Mat(nh, nw, dtype);
+            const uint8_t* base = (const uint8_t*)info.ptr;
+            for (int y = 0; y < nh; ++y)
+            {
+                uint8_t* dst = value.ptr(y);
+                for (int x = 0; x < nw; ++x)
+                {
+                    for (int c = 0; c < nc; ++c, dst += elemsize)
+                    {
+                        const uint8_t* src = base + y * info.strides[0] + x * info.strides[1] + (ndims == 3 ? c * info.strides[2] : 0);
+                        memcpy(dst, src, elemsize);
+                    }
+                }
+            }
+        }
         return true;
     }
 
@@ -140,6 +168,16 @@ public:
     }
 
 
+    bool autoSlicePrepare(int width, int height)
+    {
+        return instance_->prepare(width, height);
+    }
+
+    bool manualSlicePrepare(int width, int height, int slice_width, int slice_height, float xratio, float yratio)
+    {
+        return instance_->prepare(width, height, slice_width, slice_height, xratio, yratio);
+    }
+
     bool valid()
     {
         return instance_ != nullptr;
@@ -191,5 +229,13 @@ PYBIND11_MODULE(trtsahiyolo, m){
 			py::arg("width"), 
 			py::arg("height"), 
 			py::arg("xratio"), 
+			py::arg("yratio"))
+	.def("autoSlicePrepare", &TrtSahiYolo::autoSlicePrepare, py::arg("width"), py::arg("height"))
+	.def("manualSlicePrepare", &TrtSahiYolo::manualSlicePrepare,
+			py::arg("width"),
+			py::arg("height"),
+			py::arg("slice_width"),
+			py::arg("slice_height"),
+			py::arg("xratio"),
 			py::arg("yratio"));
 };
@@ -6,11 +6,35 @@ void v5NoSlicedInfer();
 void v5SlicedInfer();
 
 void SpeedTest();
+void AffineHostSpeedTest();
+void SamplingTableSpeedTest();
+void AffineTest();
+void AffineHostTest();
+void ColorTest();
+void NmsHostTest();
+void NmsTest();
+void PlannerTest();
+void SlicePlaneHostTest();
+void SliceHostTest();
+void OwnershipTest();
+void RoundsTest();
 
 int main()
 {
     v11SlicedInfer();
     // v5SlicedInfer();
     // SpeedTest();
+    // AffineHostSpeedTest();
+    // SamplingTableSpeedTest();
+    // AffineTest();
+    // AffineHostTest();
+    // ColorTest();
+    // NmsHostTest();
+    // NmsTest();
+    // PlannerTest();
+    // SlicePlaneHostTest();
+    // SliceHostTest();
+    // OwnershipTest();
+    // RoundsTest();
     return 0;
 }
\ No newline at end of file
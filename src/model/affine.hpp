@@ -2,7 +2,20 @@
 #define AFFINE_HPP__
 
 #include <memory>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <cuda_runtime.h>
+#ifdef __CUDACC__
+#include <cuda_fp16.h>
+#endif
+
+// the per pixel math is shared by the kernels and the host reference
+#ifdef __CUDACC__
+#define AFFINE_HOST_DEVICE __host__ __device__
+#else
+#define AFFINE_HOST_DEVICE
+#endif
 
 namespace affine
 {
@@ -11,6 +24,87 @@ enum class NormType : int { None = 0, MeanStd = 1, AlphaBeta = 2 };
 
 enum class ChannelType : int { None = 0, SwapRB = 1 };
 
+// UInt8 is for engines that normalize inside the graph, the warp then only resizes
+enum class OutputType : int { Float32 = 0, Float16 = 1, UInt8 = 2 };
+
+// fp16 element of the network input, same bits as __half
+struct Half
+{
+    uint16_t bits;
+};
+
+inline size_t output_type_size(OutputType type)
+{
+    switch (type)
+    {
+    case OutputType::Float16: return sizeof(Half);
+    case OutputType::UInt8: return sizeof(uint8_t);
+    default: return sizeof(float);
+    }
+}
+
+// float to fp16 with round to nearest even, the host path gives the same bits as __float2half_rn
+inline AFFINE_HOST_DEVICE uint16_t float_to_half_bits(float value)
+{
+#ifdef __CUDA_ARCH__
+    return __half_as_ushort(__float2half_rn(value));
+#else
+    uint32_t x;
+    memcpy(&x, &value, sizeof(x));
+    uint32_t sign = (x >> 16) & 0x8000;
+    uint32_t exponent = (x >> 23) & 0xFF;
+    uint32_t mantissa = x & 0x7FFFFF;
+    if (exponent == 0xFF) return sign | 0x7C00 | (mantissa ? 0x200 : 0);
+
+    int e = (int)exponent - 127 + 15;
+    if (e >= 31) return sign | 0x7C00;
+    if (e <= 0)
+    {
+        // subnormal or zero
+        if (e < -10) return sign;
+        mantissa |= 0x800000;
+        int shift = 14 - e;
+        uint32_t h = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1), halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (h & 1))) ++h;
+        return sign | h;
+    }
+
+    // a carry out of the mantissa moves to the next exponent, up to infinity
+    uint32_t h = ((uint32_t)e << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1FFF;
+    if (rest > 0x1000 || (rest == 0x1000 && (h & 1))) ++h;
+    return sign | h;
+#endif
+}
+
+inline float half_bits_to_float(uint16_t bits)
+{
+    uint32_t sign = (uint32_t)(bits & 0x8000) << 16;
+    uint32_t exponent = (bits >> 10) & 0x1F;
+    uint32_t mantissa = bits & 0x3FF;
+    uint32_t x;
+    if (exponent == 0x1F) x = sign | 0x7F800000 | (mantissa << 13);
+    else if (exponent != 0) x = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    else if (mantissa == 0) x = sign;
+    else
+    {
+        // subnormal, normalize it
+        exponent = 113;
+        while ((mantissa & 0x400) == 0)
+        {
+            mantissa <<= 1;
+            --exponent;
+        }
+        x = sign | (exponent << 23) | ((mantissa & 0x3FF) << 13);
+    }
+    float value;
+    memcpy(&value, &x, sizeof(value));
+    return value;
+}
+
+enum class OutputLayout : int { Planar = 0, Packed = 1 };
+
 struct Norm 
 {
     float mean[3];
@@ -71,11 +165,13 @@ struct LetterBoxMatrix
     float i2d[6];  // image to dst(network), 2x3 matrix
     float d2i[6];  // dst to image, 2x3 matrix
 
-    void compute(const std::tuple<int, int> &from, const std::tuple<int, int> &to) 
+    // max_scale > 0 caps the scale, a cropped slice then keeps the scale of the full slices
+    void compute(const std::tuple<int, int> &from, const std::tuple<int, int> &to, float max_scale = 0) 
     {
         float scale_x = std::get<0>(to) / (float)std::get<0>(from);
         float scale_y = std::get<1>(to) / (float)std::get<1>(from);
         float scale = std::min(scale_x, scale_y);
+        if (max_scale > 0) scale = std::min(scale, max_scale);
 
         // letter box
         i2d[0] = scale;
@@ -101,12 +197,287 @@ struct LetterBoxMatrix
     }
 };
 
+// one item of a batched warp, the source view and its dst to src matrix
+struct WarpTile
+{
+    const uint8_t *src = nullptr;
+    int src_line_size = 0;
+    int src_width  = 0;
+    int src_height = 0;
+    float matrix[6];
+};
+
+// bilinear sample of (src_x, src_y) rounded like opencv, const_value outside the image
+inline AFFINE_HOST_DEVICE void sample_bilinear(const uint8_t *src, int src_line_size, int src_width, int src_height,
+                                               float src_x, float src_y, uint8_t const_value_st,
+                                               float &c0, float &c1, float &c2)
+{
+    if (src_x <= -1 || src_x >= src_width || src_y <= -1 || src_y >= src_height) 
+    {
+        // out of range
+        c0 = const_value_st;
+        c1 = const_value_st;
+        c2 = const_value_st;
+        return;
+    } 
+
+    int y_low = floorf(src_y);
+    int x_low = floorf(src_x);
+    int y_high = y_low + 1;
+    int x_high = x_low + 1;
+
+    uint8_t const_value[] = {const_value_st, const_value_st, const_value_st};
+    float ly = src_y - y_low;
+    float lx = src_x - x_low;
+    float hy = 1 - ly;
+    float hx = 1 - lx;
+    float w1 = hy * hx, w2 = hy * lx, w3 = ly * hx, w4 = ly * lx;
+    const uint8_t *v1 = const_value;
+    const uint8_t *v2 = const_value;
+    const uint8_t *v3 = const_value;
+    const uint8_t *v4 = const_value;
+    if (y_low >= 0) 
+    {
+        if (x_low >= 0) v1 = src + y_low * src_line_size + x_low * 3;
+
+        if (x_high < src_width) v2 = src + y_low * src_line_size + x_high * 3;
+    }
+
+    if (y_high < src_height) 
+    {
+        if (x_low >= 0) v3 = src + y_high * src_line_size + x_low * 3;
+
+        if (x_high < src_width) v4 = src + y_high * src_line_size + x_high * 3;
+    }
+
+    // same to opencv
+    c0 = floorf(w1 * v1[0] + w2 * v2[0] + w3 * v3[0] + w4 * v4[0] + 0.5f);
+    c1 = floorf(w1 * v1[1] + w2 * v2[1] + w3 * v3[1] + w4 * v4[1] + 0.5f);
+    c2 = floorf(w1 * v1[2] + w2 * v2[2] + w3 * v3[2] + w4 * v4[2] + 0.5f);
+}
+
+// bilinear sample of dst pixel (dx, dy), normalized and written to the three planes of dst.
+// branches on the norm at runtime, kept as the reference of the specialized versions below
+inline AFFINE_HOST_DEVICE void warp_affine_pixel(const uint8_t *src, int src_line_size, int src_width,
+                                                 int src_height, float *dst, int dst_width, int dst_height,
+                                                 const float *m, uint8_t const_value_st, const Norm &norm,
+                                                 int dx, int dy)
+{
+    float src_x = m[0] * dx + m[1] * dy + m[2];
+    float src_y = m[3] * dx + m[4] * dy + m[5];
+    float c0, c1, c2;
+    sample_bilinear(src, src_line_size, src_width, src_height, src_x, src_y, const_value_st, c0, c1, c2);
+
+    if (norm.channel_type == ChannelType::SwapRB) 
+    {
+        float t = c2;
+        c2 = c0;
+        c0 = t;
+    }
+
+    if (norm.type == NormType::MeanStd) 
+    {
+        c0 = (c0 * norm.alpha - norm.mean[0]) / norm.std[0];
+        c1 = (c1 * norm.alpha - norm.mean[1]) / norm.std[1];
+        c2 = (c2 * norm.alpha - norm.mean[2]) / norm.std[2];
+    } 
+    else if (norm.type == NormType::AlphaBeta) 
+    {
+        c0 = c0 * norm.alpha + norm.beta;
+        c1 = c1 * norm.alpha + norm.beta;
+        c2 = c2 * norm.alpha + norm.beta;
+    }
+
+    int area = dst_width * dst_height;
+    float *pdst_c0 = dst + dy * dst_width + dx;
+    float *pdst_c1 = pdst_c0 + area;
+    float *pdst_c2 = pdst_c1 + area;
+    *pdst_c0 = c0;
+    *pdst_c1 = c1;
+    *pdst_c2 = c2;
+}
+
+// the norm mode and channel order as template arguments, the branches fold away at compile time
+template <NormType N, ChannelType C>
+inline AFFINE_HOST_DEVICE void normalize_pixel(const Norm &norm, float &c0, float &c1, float &c2)
+{
+    if (C == ChannelType::SwapRB) 
+    {
+        float t = c2;
+        c2 = c0;
+        c0 = t;
+    }
+
+    if (N == NormType::MeanStd) 
+    {
+        c0 = (c0 * norm.alpha - norm.mean[0]) / norm.std[0];
+        c1 = (c1 * norm.alpha - norm.mean[1]) / norm.std[1];
+        c2 = (c2 * norm.alpha - norm.mean[2]) / norm.std[2];
+    } 
+    else if (N == NormType::AlphaBeta) 
+    {
+        c0 = c0 * norm.alpha + norm.beta;
+        c1 = c1 * norm.alpha + norm.beta;
+        c2 = c2 * norm.alpha + norm.beta;
+    }
+}
+
+template <typename T>
+inline AFFINE_HOST_DEVICE T convert_output(float v) { return (T)v; }
+
+// the bilinear samples are whole numbers in [0, 255] already, the clamp only guards a norm left on
+template <>
+inline AFFINE_HOST_DEVICE uint8_t convert_output<uint8_t>(float v)
+{
+    return v <= 0 ? 0 : (v >= 255 ? 255 : (uint8_t)v);
+}
+
+template <>
+inline AFFINE_HOST_DEVICE Half convert_output<Half>(float v)
+{
+    Half h;
+    h.bits = float_to_half_bits(v);
+    return h;
+}
+
+// Planar is NCHW (three planes), Packed is NHWC (three channels per pixel)
+template <typename T, OutputLayout L>
+inline AFFINE_HOST_DEVICE void store_pixel(T *dst, int dst_width, int dst_height, int dx, int dy,
+                                           float c0, float c1, float c2)
+{
+    if (L == OutputLayout::Planar)
+    {
+        int area = dst_width * dst_height;
+        T *pdst_c0 = dst + dy * dst_width + dx;
+        pdst_c0[0]        = convert_output<T>(c0);
+        pdst_c0[area]     = convert_output<T>(c1);
+        pdst_c0[area * 2] = convert_output<T>(c2);
+    }
+    else
+    {
+        T *pdst = dst + (dy * dst_width + dx) * 3;
+        pdst[0] = convert_output<T>(c0);
+        pdst[1] = convert_output<T>(c1);
+        pdst[2] = convert_output<T>(c2);
+    }
+}
+
+// warp_affine_pixel specialized on the norm, the channel order, the output type and the layout
+template <NormType N, ChannelType C, typename T, OutputLayout L>
+inline AFFINE_HOST_DEVICE void warp_affine_pixel_t(const uint8_t *src, int src_line_size, int src_width,
+                                                   int src_height, T *dst, int dst_width, int dst_height,
+                                                   const float *m, uint8_t const_value_st, const Norm &norm,
+                                                   int dx, int dy)
+{
+    float src_x = m[0] * dx + m[1] * dy + m[2];
+    float src_y = m[3] * dx + m[4] * dy + m[5];
+    float c0, c1, c2;
+    sample_bilinear(src, src_line_size, src_width, src_height, src_x, src_y, const_value_st, c0, c1, c2);
+    normalize_pixel<N, C>(norm, c0, c1, c2);
+    store_pixel<T, L>(dst, dst_width, dst_height, dx, dy, c0, c1, c2);
+}
+
+// calls Select<N, C, T, L>::get(args...) with the instantiation matching the runtime norm, type and layout,
+// so the choice is made once and not per pixel
+template <template <NormType, ChannelType, typename, OutputLayout> class Select, NormType N, ChannelType C,
+          typename T, typename... Args>
+inline auto dispatch_warp_layout(OutputLayout layout, Args... args)
+{
+    return layout == OutputLayout::Packed ? Select<N, C, T, OutputLayout::Packed>::get(args...)
+                                          : Select<N, C, T, OutputLayout::Planar>::get(args...);
+}
+
+template <template <NormType, ChannelType, typename, OutputLayout> class Select, NormType N, ChannelType C,
+          typename... Args>
+inline auto dispatch_warp_type(OutputType type, OutputLayout layout, Args... args)
+{
+    switch (type)
+    {
+    case OutputType::Float16:
+        return dispatch_warp_layout<Select, N, C, Half>(layout, args...);
+    case OutputType::UInt8:
+        return dispatch_warp_layout<Select, N, C, uint8_t>(layout, args...);
+    case OutputType::Float32:
+    default:
+        return dispatch_warp_layout<Select, N, C, float>(layout, args...);
+    }
+}
+
+template <template <NormType, ChannelType, typename, OutputLayout> class Select, NormType N, typename... Args>
+inline auto dispatch_warp_channel(ChannelType channel_type, OutputType type, OutputLayout layout, Args... args)
+{
+    return channel_type == ChannelType::SwapRB
+               ? dispatch_warp_type<Select, N, ChannelType::SwapRB>(type, layout, args...)
+               : dispatch_warp_type<Select, N, ChannelType::None>(type, layout, args...);
+}
+
+template <template <NormType, ChannelType, typename, OutputLayout> class Select, typename... Args>
+inline auto dispatch_warp(const Norm &norm, OutputType type, OutputLayout layout, Args... args)
+{
+    switch (norm.type)
+    {
+    case NormType::MeanStd:
+        return dispatch_warp_channel<Select, NormType::MeanStd>(norm.channel_type, type, layout, args...);
+    case NormType::AlphaBeta:
+        return dispatch_warp_channel<Select, NormType::AlphaBeta>(norm.channel_type, type, layout, args...);
+    default:
+        return dispatch_warp_channel<Select, NormType::None>(norm.channel_type, type, layout, args...);
+    }
+}
+
+// specialized entry points, dst is of the selected output type.
+// plane takes a device matrix, batch device tiles, host_batch host tiles
+typedef void (*WarpPlaneFn)(uint8_t *src, int src_line_size, int src_width, int src_height, void *dst,
+                            int dst_width, int dst_height, float *matrix_2_3, uint8_t const_value,
+                            const Norm &norm, cudaStream_t stream);
+typedef void (*WarpBatchFn)(const WarpTile *tiles, int num_tiles, void *dst, int dst_width, int dst_height,
+                            uint8_t const_value, const Norm &norm, cudaStream_t stream);
+typedef void (*WarpBatchHostFn)(const WarpTile *tiles, int num_tiles, void *dst, int dst_width, int dst_height,
+                                uint8_t const_value, const Norm &norm);
+
+struct WarpKernels
+{
+    WarpPlaneFn plane = nullptr;
+    WarpBatchFn batch = nullptr;
+};
+
+// kernels for the norm mode and channel order of norm, chosen once when a model is loaded
+WarpKernels select_warp(const Norm &norm, OutputType type = OutputType::Float32,
+                        OutputLayout layout = OutputLayout::Planar);
+
+// host twin of select_warp. vectorize = false keeps the scalar rows even if the cpu has AVX2 (and F16C for Float16)
+WarpBatchHostFn select_warp_host(const Norm &norm, OutputType type = OutputType::Float32,
+                                 OutputLayout layout = OutputLayout::Planar, bool vectorize = true);
+
 void warp_affine_bilinear_and_normalize_plane(uint8_t *src, int src_line_size, int src_width,
                                                 int src_height, float *dst, int dst_width,
                                                 int dst_height, float *matrix_2_3,
                                                 uint8_t const_value, const Norm &norm,
                                                 cudaStream_t stream);
 
+// every tile is warped into its own dst_width x dst_height planar slot of dst in a single launch.
+// tiles and the pixels they point at must be in device memory
+void warp_affine_bilinear_and_normalize_plane_batch(const WarpTile *tiles, int num_tiles, float *dst,
+                                                    int dst_width, int dst_height, uint8_t const_value,
+                                                    const Norm &norm, cudaStream_t stream);
+
+// host versions of the two entry points (float planar), same semantics as the kernels.
+// rows are vectorized with AVX2 when the cpu has it and spread over the cores with OpenMP
+void warp_affine_bilinear_and_normalize_plane_host(const uint8_t *src, int src_line_size, int src_width,
+                                                   int src_height, float *dst, int dst_width,
+                                                   int dst_height, const float *matrix_2_3,
+                                                   uint8_t const_value, const Norm &norm);
+
+// plain scalar loop over warp_affine_pixel, the reference the host and cuda versions are checked against
+void warp_affine_bilinear_and_normalize_plane_reference(const uint8_t *src, int src_line_size, int src_width,
+                                                        int src_height, float *dst, int dst_width,
+                                                        int dst_height, const float *matrix_2_3,
+                                                        uint8_t const_value, const Norm &norm);
+
+void warp_affine_bilinear_and_normalize_plane_batch_host(const WarpTile *tiles, int num_tiles, float *dst,
+                                                         int dst_width, int dst_height, uint8_t const_value,
+                                                         const Norm &norm);
+
 }
 
 
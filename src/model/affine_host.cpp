@@ -0,0 +1,273 @@
+#include "model/affine.hpp"
+#include <cstring>
+#include <utility>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define AFFINE_HOST_X86 1
+#endif
+
+namespace affine
+{
+
+Norm Norm::mean_std(const float mean[3], const float std[3], float alpha,
+                    ChannelType channel_type) 
+{
+    Norm out;
+    out.type = NormType::MeanStd;
+    out.alpha = alpha;
+    out.channel_type = channel_type;
+    memcpy(out.mean, mean, sizeof(out.mean));
+    memcpy(out.std, std, sizeof(out.std));
+    return out;
+}
+
+Norm Norm::alpha_beta(float alpha, float beta, ChannelType channel_type) 
+{
+    Norm out;
+    out.type = NormType::AlphaBeta;
+    out.alpha = alpha;
+    out.beta = beta;
+    out.channel_type = channel_type;
+    return out;
+}
+
+Norm Norm::None() { return Norm(); }
+
+static void warp_row(const uint8_t *src, int src_line_size, int src_width, int src_height, float *dst,
+                     int dst_width, int dst_height, const float *m, uint8_t const_value, const Norm &norm, int dy)
+{
+    for (int dx = 0; dx < dst_width; ++dx)
+        warp_affine_pixel(src, src_line_size, src_width, src_height, dst, dst_width, dst_height, m, const_value, norm, dx, dy);
+}
+
+// scalar row with the norm, type and layout baked in
+template <NormType N, ChannelType C, typename T, OutputLayout L>
+static void warp_row_t(const uint8_t *src, int src_line_size, int src_width, int src_height, T *dst,
+                       int dst_width, int dst_height, const float *m, uint8_t const_value, const Norm &norm, int dy)
+{
+    for (int dx = 0; dx < dst_width; ++dx)
+        warp_affine_pixel_t<N, C, T, L>(src, src_line_size, src_width, src_height, dst, dst_width, dst_height,
+                                        m, const_value, norm, dx, dy);
+}
+
+#ifdef AFFINE_HOST_X86
+// 8 pixels at a time. blocks whose samples are all inside the image (with one spare pixel on the right,
+// the gathers load 4 bytes per pixel) or all outside are vectorized, mixed blocks go through warp_affine_pixel_t.
+// the arithmetic is done in the same order as the scalar code, without fma, so the results match it.
+// fp16 output is converted with F16C, round to nearest even like float_to_half_bits
+__attribute__((target("avx2,f16c")))
+static inline void store8(float *dst, __m256 v) { _mm256_storeu_ps(dst, v); }
+
+__attribute__((target("avx2,f16c")))
+static inline void store8(Half *dst, __m256 v)
+{
+    _mm_storeu_si128((__m128i *)dst, _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+}
+
+template <NormType N, ChannelType C, typename T>
+__attribute__((target("avx2,f16c")))
+static void warp_row_avx2(const uint8_t *src, int src_line_size, int src_width, int src_height, T *dst,
+                          int dst_width, int dst_height, const float *m, uint8_t const_value, const Norm &norm, int dy)
+{
+    const int area = dst_width * dst_height;
+    T *pdst_c0 = dst + dy * dst_width;
+    T *pdst_c1 = pdst_c0 + area;
+    T *pdst_c2 = pdst_c1 + area;
+
+    const __m256 one   = _mm256_set1_ps(1.0f);
+    const __m256 half  = _mm256_set1_ps(0.5f);
+    const __m256 lanes = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i mask = _mm256_set1_epi32(0xFF);
+    const __m256 y_term_x = _mm256_set1_ps(m[1] * (float)dy);
+    const __m256 y_term_y = _mm256_set1_ps(m[4] * (float)dy);
+    const __m256 m0 = _mm256_set1_ps(m[0]), m2 = _mm256_set1_ps(m[2]);
+    const __m256 m3 = _mm256_set1_ps(m[3]), m5 = _mm256_set1_ps(m[5]);
+
+    // per channel affine of the norm, out = c * scale + bias (MeanStd divides like the kernel)
+    const bool mean_std = N == NormType::MeanStd;
+    const bool alpha_beta = N == NormType::AlphaBeta;
+    const bool swap = C == ChannelType::SwapRB;
+    __m256 alpha = _mm256_set1_ps(norm.alpha), beta = _mm256_set1_ps(norm.beta);
+    __m256 mean[3], std[3];
+    for (int c = 0; c < 3; ++c)
+    {
+        mean[c] = _mm256_set1_ps(mean_std ? norm.mean[c] : 0.0f);
+        std[c]  = _mm256_set1_ps(mean_std ? norm.std[c] : 1.0f);
+    }
+
+    int dx = 0;
+    for (; dx + 8 <= dst_width; dx += 8)
+    {
+        __m256 fdx = _mm256_add_ps(_mm256_set1_ps((float)dx), lanes);
+        __m256 src_x = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m0, fdx), y_term_x), m2);
+        __m256 src_y = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m3, fdx), y_term_y), m5);
+
+        __m256 x_low_f = _mm256_floor_ps(src_x);
+        __m256 y_low_f = _mm256_floor_ps(src_y);
+        __m256i x_low = _mm256_cvttps_epi32(x_low_f);
+        __m256i y_low = _mm256_cvttps_epi32(y_low_f);
+
+        // all samples out of range: constant block
+        __m256 out = _mm256_or_ps(
+            _mm256_or_ps(_mm256_cmp_ps(src_x, _mm256_set1_ps(-1.0f), _CMP_LE_OQ),
+                         _mm256_cmp_ps(src_x, _mm256_set1_ps((float)src_width), _CMP_GE_OQ)),
+            _mm256_or_ps(_mm256_cmp_ps(src_y, _mm256_set1_ps(-1.0f), _CMP_LE_OQ),
+                         _mm256_cmp_ps(src_y, _mm256_set1_ps((float)src_height), _CMP_GE_OQ)));
+        int out_bits = _mm256_movemask_ps(out);
+
+        // all samples and their right and bottom neighbours inside: gathered block
+        __m256i inside = _mm256_and_si256(
+            _mm256_and_si256(_mm256_cmpgt_epi32(x_low, _mm256_set1_epi32(-1)),
+                             _mm256_cmpgt_epi32(_mm256_set1_epi32(src_width - 2), x_low)),
+            _mm256_and_si256(_mm256_cmpgt_epi32(y_low, _mm256_set1_epi32(-1)),
+                             _mm256_cmpgt_epi32(_mm256_set1_epi32(src_height - 1), y_low)));
+        int inside_bits = _mm256_movemask_ps(_mm256_castsi256_ps(inside));
+
+        __m256 c[3];
+        if (out_bits == 0xFF)
+        {
+            c[0] = c[1] = c[2] = _mm256_set1_ps((float)const_value);
+        }
+        else if (inside_bits == 0xFF && out_bits == 0)
+        {
+            __m256 lx = _mm256_sub_ps(src_x, x_low_f);
+            __m256 ly = _mm256_sub_ps(src_y, y_low_f);
+            __m256 hx = _mm256_sub_ps(one, lx);
+            __m256 hy = _mm256_sub_ps(one, ly);
+            __m256 w1 = _mm256_mul_ps(hy, hx), w2 = _mm256_mul_ps(hy, lx);
+            __m256 w3 = _mm256_mul_ps(ly, hx), w4 = _mm256_mul_ps(ly, lx);
+
+            __m256i offset1 = _mm256_add_epi32(_mm256_mullo_epi32(y_low, _mm256_set1_epi32(src_line_size)),
+                                               _mm256_mullo_epi32(x_low, _mm256_set1_epi32(3)));
+            __m256i offset2 = _mm256_add_epi32(offset1, _mm256_set1_epi32(3));
+            __m256i offset3 = _mm256_add_epi32(offset1, _mm256_set1_epi32(src_line_size));
+            __m256i offset4 = _mm256_add_epi32(offset3, _mm256_set1_epi32(3));
+            __m256i v1 = _mm256_i32gather_epi32((const int *)src, offset1, 1);
+            __m256i v2 = _mm256_i32gather_epi32((const int *)src, offset2, 1);
+            __m256i v3 = _mm256_i32gather_epi32((const int *)src, offset3, 1);
+            __m256i v4 = _mm256_i32gather_epi32((const int *)src, offset4, 1);
+            for (int ic = 0; ic < 3; ++ic)
+            {
+                __m256 p1 = _mm256_cvtepi32_ps(_mm256_and_si256(v1, mask));
+                __m256 p2 = _mm256_cvtepi32_ps(_mm256_and_si256(v2, mask));
+                __m256 p3 = _mm256_cvtepi32_ps(_mm256_and_si256(v3, mask));
+                __m256 p4 = _mm256_cvtepi32_ps(_mm256_and_si256(v4, mask));
+                __m256 sum = _mm256_add_ps(_mm256_mul_ps(w1, p1), _mm256_mul_ps(w2, p2));
+                sum = _mm256_add_ps(sum, _mm256_mul_ps(w3, p3));
+                sum = _mm256_add_ps(sum, _mm256_mul_ps(w4, p4));
+                c[ic] = _mm256_floor_ps(_mm256_add_ps(sum, half));
+                v1 = _mm256_srli_epi32(v1, 8);
+                v2 = _mm256_srli_epi32(v2, 8);
+                v3 = _mm256_srli_epi32(v3, 8);
+                v4 = _mm256_srli_epi32(v4, 8);
+            }
+        }
+        else
+        {
+            for (int i = 0; i < 8; ++i)
+                warp_affine_pixel_t<N, C, T, OutputLayout::Planar>(src, src_line_size, src_width, src_height, dst, dst_width, dst_height, m, const_value, norm, dx + i, dy);
+            continue;
+        }
+
+        if (swap) std::swap(c[0], c[2]);
+        for (int ic = 0; ic < 3; ++ic)
+        {
+            if (mean_std)
+                c[ic] = _mm256_div_ps(_mm256_sub_ps(_mm256_mul_ps(c[ic], alpha), mean[ic]), std[ic]);
+            else if (alpha_beta)
+                c[ic] = _mm256_add_ps(_mm256_mul_ps(c[ic], alpha), beta);
+        }
+        store8(pdst_c0 + dx, c[0]);
+        store8(pdst_c1 + dx, c[1]);
+        store8(pdst_c2 + dx, c[2]);
+    }
+
+    for (; dx < dst_width; ++dx)
+        warp_affine_pixel_t<N, C, T, OutputLayout::Planar>(src, src_line_size, src_width, src_height, dst, dst_width, dst_height, m, const_value, norm, dx, dy);
+}
+#endif
+
+// rows of all tiles are spread over the cores together
+template <typename T, void (*Row)(const uint8_t *, int, int, int, T *, int, int, const float *, uint8_t, const Norm &, int)>
+static void warp_batch_host(const WarpTile *tiles, int num_tiles, void *dst, int dst_width, int dst_height,
+                            uint8_t const_value, const Norm &norm)
+{
+    #pragma omp parallel for collapse(2) schedule(static)
+    for (int i = 0; i < num_tiles; ++i)
+    {
+        for (int dy = 0; dy < dst_height; ++dy)
+        {
+            const WarpTile &tile = tiles[i];
+            Row(tile.src, tile.src_line_size, tile.src_width, tile.src_height,
+                (T *)dst + (size_t)i * dst_width * dst_height * 3, dst_width, dst_height,
+                tile.matrix, const_value, norm, dy);
+        }
+    }
+}
+
+template <NormType N, ChannelType C, typename T, OutputLayout L>
+struct WarpHostRows
+{
+    static WarpBatchHostFn get(bool) { return warp_batch_host<T, warp_row_t<N, C, T, L>>; }
+};
+
+// planar rows have an AVX2 version
+template <NormType N, ChannelType C, typename T>
+static WarpBatchHostFn select_planar_rows(bool vectorize)
+{
+#ifdef AFFINE_HOST_X86
+    if (vectorize && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c"))
+        return warp_batch_host<T, warp_row_avx2<N, C, T>>;
+#endif
+    return warp_batch_host<T, warp_row_t<N, C, T, OutputLayout::Planar>>;
+}
+
+template <NormType N, ChannelType C>
+struct WarpHostRows<N, C, float, OutputLayout::Planar>
+{
+    static WarpBatchHostFn get(bool vectorize) { return select_planar_rows<N, C, float>(vectorize); }
+};
+
+template <NormType N, ChannelType C>
+struct WarpHostRows<N, C, Half, OutputLayout::Planar>
+{
+    static WarpBatchHostFn get(bool vectorize) { return select_planar_rows<N, C, Half>(vectorize); }
+};
+
+WarpBatchHostFn select_warp_host(const Norm &norm, OutputType type, OutputLayout layout, bool vectorize)
+{
+    return dispatch_warp<WarpHostRows>(norm, type, layout, vectorize);
+}
+
+void warp_affine_bilinear_and_normalize_plane_reference(const uint8_t *src, int src_line_size, int src_width,
+                                                        int src_height, float *dst, int dst_width,
+                                                        int dst_height, const float *matrix_2_3,
+                                                        uint8_t const_value, const Norm &norm)
+{
+    for (int dy = 0; dy < dst_height; ++dy)
+        warp_row(src, src_line_size, src_width, src_height, dst, dst_width, dst_height, matrix_2_3, const_value, norm, dy);
+}
+
+void warp_affine_bilinear_and_normalize_plane_host(const uint8_t *src, int src_line_size, int src_width,
+                                                   int src_height, float *dst, int dst_width,
+                                                   int dst_height, const float *matrix_2_3,
+                                                   uint8_t const_value, const Norm &norm)
+{
+    WarpTile tile;
+    tile.src           = src;
+    tile.src_line_size = src_line_size;
+    tile.src_width     = src_width;
+    tile.src_height    = src_height;
+    memcpy(tile.matrix, matrix_2_3, sizeof(tile.matrix));
+    select_warp_host(norm)(&tile, 1, dst, dst_width, dst_height, const_value, norm);
+}
+
+void warp_affine_bilinear_and_normalize_plane_batch_host(const WarpTile *tiles, int num_tiles, float *dst,
+                                                         int dst_width, int dst_height, uint8_t const_value,
+                                                         const Norm &norm)
+{
+    select_warp_host(norm)(tiles, num_tiles, dst, dst_width, dst_height, const_value, norm);
+}
+
+}
@@ -0,0 +1,125 @@
+#include "model/nms.hpp"
+#include "common/check.hpp"
+#include <cub/cub.cuh>
+#include <cfloat>
+#include <algorithm>
+
+namespace nms
+{
+
+// sort keys of every row of the capacity, rows past the count sort last
+static __global__ void nms_keys_kernel(const float *rows, const int *row_count, int capacity, int element,
+                                       float *keys, int *order)
+{
+    int count = min(*row_count, capacity);
+    for (int i = blockIdx.x * blockDim.x + threadIdx.x; i < capacity; i += gridDim.x * blockDim.x)
+    {
+        keys[i]  = i < count ? rows[i * element + NMS_CONFIDENCE] : -FLT_MAX;
+        order[i] = i;
+    }
+}
+
+// bit j of word (i, col_block) is set when sorted box i suppresses sorted box col_block * NMS_BLOCK + j, j > i.
+// a fixed grid walks the block pairs of the actual count, a few boxes cost a few blocks whatever the capacity
+static __global__ void nms_mask_kernel(const float *rows, const int *order, const int *row_count, int capacity,
+                                       int element, float threshold, int col_blocks, unsigned long long *mask)
+{
+    __shared__ float block_boxes[NMS_BLOCK * 5];
+
+    int count  = min(*row_count, capacity);
+    int blocks = (count + NMS_BLOCK - 1) / NMS_BLOCK;
+    for (int pair = blockIdx.x; pair < blocks * blocks; pair += gridDim.x)
+    {
+        int row_block = pair / blocks;
+        int col_block = pair % blocks;
+        if (col_block < row_block) continue;
+
+        int row_size = min(count - row_block * NMS_BLOCK, NMS_BLOCK);
+        int col_size = min(count - col_block * NMS_BLOCK, NMS_BLOCK);
+
+        __syncthreads();
+        if (threadIdx.x < col_size)
+        {
+            const float *pbox = rows + order[col_block * NMS_BLOCK + threadIdx.x] * element;
+            float *pshared = block_boxes + threadIdx.x * 5;
+            pshared[0] = pbox[0];
+            pshared[1] = pbox[1];
+            pshared[2] = pbox[2];
+            pshared[3] = pbox[3];
+            pshared[4] = pbox[NMS_LABEL];
+        }
+        __syncthreads();
+
+        if (threadIdx.x < row_size)
+        {
+            int i = row_block * NMS_BLOCK + threadIdx.x;
+            const float *pbox = rows + order[i] * element;
+            unsigned long long bits = 0;
+            int start = row_block == col_block ? threadIdx.x + 1 : 0;
+            for (int j = start; j < col_size; ++j)
+            {
+                const float *pother = block_boxes + j * 5;
+                if (suppresses(pbox, pbox[NMS_LABEL], pother, pother[4], threshold)) bits |= 1ULL << j;
+            }
+            mask[(size_t)i * col_blocks + col_block] = bits;
+        }
+    }
+}
+
+// the greedy pass over the sorted boxes in one block, removed holds a bit per sorted box.
+// only a kept box changes removed, the others cost a shared memory read
+static __global__ void nms_reduce_kernel(float *rows, const int *order, const int *row_count, int capacity,
+                                         int element, int col_blocks, const unsigned long long *mask)
+{
+    extern __shared__ unsigned long long removed[];
+
+    int count = min(*row_count, capacity);
+    int words = (count + NMS_BLOCK - 1) / NMS_BLOCK;
+    for (int w = threadIdx.x; w < words; w += blockDim.x) removed[w] = 0;
+    __syncthreads();
+
+    for (int i = 0; i < count; ++i)
+    {
+        int word = i / NMS_BLOCK;
+        bool keep = ((removed[word] >> (i % NMS_BLOCK)) & 1ULL) == 0;
+        if (threadIdx.x == 0) rows[order[i] * element + NMS_KEEPFLAG] = keep ? 1 : 0;
+        if (!keep) continue;
+
+        const unsigned long long *pmask = mask + (size_t)i * col_blocks;
+        for (int w = word + threadIdx.x; w < words; w += blockDim.x) removed[w] |= pmask[w];
+        __syncthreads();
+    }
+}
+
+void nms_rows(float *rows, const int *row_count, int capacity, int element, float threshold,
+              Workspace &workspace, cudaStream_t stream)
+{
+    if (capacity <= 0) return;
+    int col_blocks = (capacity + NMS_BLOCK - 1) / NMS_BLOCK;
+
+    // keys and order hold the input and the sorted copy back to back
+    float *keys = workspace.keys.gpu((size_t)capacity * 2);
+    int *order  = workspace.order.gpu((size_t)capacity * 2);
+    unsigned long long *mask = workspace.mask.gpu((size_t)capacity * col_blocks);
+
+    size_t temp_bytes = 0;
+    checkRuntime(cub::DeviceRadixSort::SortPairsDescending(nullptr, temp_bytes, keys, keys + capacity,
+                                                           order, order + capacity, capacity, 0, sizeof(float) * 8, stream));
+    if (workspace.sort_temp.gpu_bytes() < temp_bytes) workspace.sort_temp.gpu(temp_bytes);
+
+    int threads = 256;
+    int blocks  = std::min((capacity + threads - 1) / threads, 64);
+    checkKernel(nms_keys_kernel<<<blocks, threads, 0, stream>>>(rows, row_count, capacity, element, keys, order));
+
+    // radix sort is stable, equal confidences keep their row order like the host twin
+    checkRuntime(cub::DeviceRadixSort::SortPairsDescending(workspace.sort_temp.gpu(), temp_bytes, keys, keys + capacity,
+                                                           order, order + capacity, capacity, 0, sizeof(float) * 8, stream));
+
+    int pairs = std::min(col_blocks * col_blocks, 512);
+    checkKernel(nms_mask_kernel<<<pairs, NMS_BLOCK, 0, stream>>>(rows, order + capacity, row_count, capacity,
+                                                                 element, threshold, col_blocks, mask));
+    checkKernel(nms_reduce_kernel<<<1, 256, col_blocks * sizeof(unsigned long long), stream>>>(
+        rows, order + capacity, row_count, capacity, element, col_blocks, mask));
+}
+
+}
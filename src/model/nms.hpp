@@ -0,0 +1,100 @@
+#ifndef NMS_HPP__
+#define NMS_HPP__
+
+#include "common/memory.hpp"
+#include <cstdint>
+#include <cuda_runtime.h>
+
+// the iou is shared by the cuda kernels and the host twin
+#ifdef __CUDACC__
+#define NMS_HOST_DEVICE __host__ __device__
+#else
+#define NMS_HOST_DEVICE
+#endif
+
+namespace nms
+{
+
+// rows of the box array: left, top, right, bottom, confidence, class, keepflag, then whatever the caller keeps
+static const int NMS_CONFIDENCE = 4;
+static const int NMS_LABEL      = 5;
+static const int NMS_KEEPFLAG   = 6;
+
+// boxes compared by one block of the mask kernel, one bit each in a word of the suppression mask
+static const int NMS_BLOCK = 64;
+
+// every product and sum rounded on its own, nvcc would fuse them into fma on the device and
+// the host would no longer give the same bits
+NMS_HOST_DEVICE inline float mul_rn(float a, float b)
+{
+#ifdef __CUDA_ARCH__
+    return __fmul_rn(a, b);
+#else
+    return a * b;
+#endif
+}
+
+NMS_HOST_DEVICE inline float add_rn(float a, float b)
+{
+#ifdef __CUDA_ARCH__
+    return __fadd_rn(a, b);
+#else
+    return a + b;
+#endif
+}
+
+NMS_HOST_DEVICE inline float div_rn(float a, float b)
+{
+#ifdef __CUDA_ARCH__
+    return __fdiv_rn(a, b);
+#else
+    return a / b;
+#endif
+}
+
+NMS_HOST_DEVICE inline float max_rn(float a, float b) { return a > b ? a : b; }
+NMS_HOST_DEVICE inline float min_rn(float a, float b) { return a < b ? a : b; }
+
+// a and b point at left, top, right, bottom
+NMS_HOST_DEVICE inline float box_iou(const float *a, const float *b)
+{
+    float cleft   = max_rn(a[0], b[0]);
+    float ctop    = max_rn(a[1], b[1]);
+    float cright  = min_rn(a[2], b[2]);
+    float cbottom = min_rn(a[3], b[3]);
+
+    float c_area = mul_rn(max_rn(add_rn(cright, -cleft), 0.0f), max_rn(add_rn(cbottom, -ctop), 0.0f));
+    if (c_area == 0.0f) return 0.0f;
+
+    float a_area = mul_rn(max_rn(0.0f, add_rn(a[2], -a[0])), max_rn(0.0f, add_rn(a[3], -a[1])));
+    float b_area = mul_rn(max_rn(0.0f, add_rn(b[2], -b[0])), max_rn(0.0f, add_rn(b[3], -b[1])));
+    return div_rn(c_area, add_rn(add_rn(a_area, b_area), -c_area));
+}
+
+// a kept box a suppresses b of the same class
+NMS_HOST_DEVICE inline bool suppresses(const float *a, float a_label, const float *b, float b_label, float threshold)
+{
+    return a_label == b_label && box_iou(a, b) > threshold;
+}
+
+// device memory of nms_rows, grown to the capacity of the box array on first use
+struct Workspace
+{
+    tensor::Memory<float> keys;              // confidences, then sorted
+    tensor::Memory<int> order;               // row indices, then sorted by confidence
+    tensor::Memory<unsigned char> sort_temp;
+    tensor::Memory<unsigned long long> mask; // NMS_BLOCK boxes per word, one row of words per sorted box
+};
+
+// greedy class aware nms of the first min(*row_count, capacity) rows, most confident first and on equal
+// confidence the lower row first. keepflag of every row is set to 1 or 0, the rows stay where they are.
+// rows are element floats apart, row_count is on the device and never read on the host
+void nms_rows(float *rows, const int *row_count, int capacity, int element, float threshold,
+              Workspace &workspace, cudaStream_t stream);
+
+// host twin of nms_rows, same keepflags bit for bit
+void nms_rows_host(float *rows, int count, int element, float threshold);
+
+}
+
+#endif
@@ -0,0 +1,41 @@
+#include "model/nms.hpp"
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+namespace nms
+{
+
+void nms_rows_host(float *rows, int count, int element, float threshold)
+{
+    // stable like the radix sort of the device
+    std::vector<int> order(std::max(count, 0));
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+        return rows[a * element + NMS_CONFIDENCE] > rows[b * element + NMS_CONFIDENCE];
+    });
+
+    // a box only meets the kept boxes of its own class, the iou is the one of the kernels
+    std::vector<std::vector<int>> kept;
+    for (int i : order)
+    {
+        float *pbox = rows + i * element;
+        int label = (int)pbox[NMS_LABEL];
+        if (label >= (int)kept.size()) kept.resize(label + 1);
+
+        bool keep = true;
+        for (int k : kept[label])
+        {
+            const float *pkept = rows + k * element;
+            if (suppresses(pkept, pkept[NMS_LABEL], pbox, pbox[NMS_LABEL], threshold))
+            {
+                keep = false;
+                break;
+            }
+        }
+        pbox[NMS_KEEPFLAG] = keep ? 1 : 0;
+        if (keep) kept[label].push_back(i);
+    }
+}
+
+}
@@ -0,0 +1,191 @@
+#ifndef PLAN_HPP__
+#define PLAN_HPP__
+
+#include <list>
+#include <memory>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+#include "common/memory.hpp"
+#include "model/affine.hpp"
+#include <cuda_runtime.h>
+
+namespace yolo
+{
+
+// frame geometry an execution plan is built for, the engine is implied by the model owning the cache
+struct PlanKey
+{
+    int width  = 0;
+    int height = 0;
+
+    // 0 means the slice size is chosen by the SlicePlanner
+    int slice_width  = 0;
+    int slice_height = 0;
+    int overlap_width_pixel  = 0;
+    int overlap_height_pixel = 0;
+
+    // the whole frame is inferred as one more batch item after the slices
+    bool full_frame = false;
+
+    // only the slices touching the roi of the model are kept
+    bool roi = false;
+
+    // edge slices are shifted back inside the frame instead of being cropped
+    bool shift_edges = true;
+
+    bool operator==(const PlanKey &other) const
+    {
+        return width == other.width && height == other.height &&
+               slice_width == other.slice_width && slice_height == other.slice_height &&
+               overlap_width_pixel == other.overlap_width_pixel &&
+               overlap_height_pixel == other.overlap_height_pixel &&
+               full_frame == other.full_frame && roi == other.roi &&
+               shift_edges == other.shift_edges;
+    }
+};
+
+struct PlanKeyHash
+{
+    size_t operator()(const PlanKey &key) const
+    {
+        size_t h = 0;
+        for (int v : {key.width, key.height, key.slice_width, key.slice_height,
+                      key.overlap_width_pixel, key.overlap_height_pixel, (int)key.full_frame, (int)key.roi, (int)key.shift_edges})
+        {
+            h = h * 1000003u ^ std::hash<int>()(v);
+        }
+        return h;
+    }
+};
+
+// warp tiles of every image of a plan, built for one device frame of the upload ring
+struct TileSet
+{
+    const uint8_t *frame  = nullptr;   // device frame the tiles read
+    const uint8_t *slices = nullptr;   // materialized slices, nullptr when the slices are views of the frame
+    tensor::Memory<affine::WarpTile> tiles;
+};
+
+// Everything a frame needs that only depends on its geometry.
+// Built once, the device copies are uploaded at build time and never touched again.
+struct ExecutionPlan
+{
+    ExecutionPlan() = default;
+    ExecutionPlan(const ExecutionPlan &) = delete;
+    ExecutionPlan &operator=(const ExecutionPlan &) = delete;
+
+    // the pinned host copies are freed only once their uploads have run
+    ~ExecutionPlan()
+    {
+        if (uploaded == nullptr) return;
+        cudaEventSynchronize(uploaded);
+        cudaEventDestroy(uploaded);
+    }
+
+    PlanKey key;
+
+    int width  = 0;
+    int height = 0;
+    int slice_width  = 0;
+    int slice_height = 0;
+    int slice_num_h  = 0;
+    int slice_num_v  = 0;
+    bool full_frame  = false;
+
+    // x, y of every slice in the original image, the full frame item starts at 0, 0
+    tensor::Memory<int> slice_start_point;
+
+    // width, height of every image, slices cropped by the frame border are smaller than slice_width x slice_height
+    std::vector<int> slice_size;
+
+    // dst(network) to slice matrix of every image, 6 floats each, built from its own size
+    tensor::Memory<float> affine_matrix;
+
+    // core region of every image, 4 floats each, only grid plans have them
+    tensor::Memory<float> slice_core;
+    bool has_core = false;
+
+    // rasterized roi of the frame, roi_cell == 0 means no roi
+    tensor::Memory<uint8_t> roi_mask;
+    int roi_cols = 0;
+    int roi_rows = 0;
+    int roi_cell = 0;
+
+    // elements of one batch item of the engine input and output
+    size_t input_numel  = 0;
+    size_t output_numel = 0;
+
+    // batch the input and output buffers are sized for
+    int infer_batch_size = 0;
+
+    // 0 .. image_num() - 1 on the device, the batch of a frame without skipped slices
+    tensor::Memory<int> all_slices;
+
+    // tiles of the frames seen with this plan, most recent first. a frame without skipped slices takes its tiles
+    // from here instead of building and uploading them
+    std::list<TileSet> tile_sets;
+
+    // {first slice, number of slices} and the engine input dims of every round
+    std::vector<std::tuple<int, int>> rounds;
+    std::vector<std::vector<int>> run_dims;
+
+    // recorded after the uploads of the host copies, which stay untouched until it has fired
+    cudaEvent_t uploaded = nullptr;
+
+    inline int slice_num() const { return slice_num_h * slice_num_v; }
+
+    // slices plus the full frame item, which has index slice_num()
+    inline int image_num() const { return slice_num() + (full_frame ? 1 : 0); }
+};
+
+// least recently used cache of execution plans
+class PlanCache
+{
+public:
+    explicit PlanCache(size_t capacity = 8) : capacity_(capacity) {}
+
+    std::shared_ptr<ExecutionPlan> get(const PlanKey &key)
+    {
+        auto iter = index_.find(key);
+        if (iter == index_.end()) return nullptr;
+
+        plans_.splice(plans_.begin(), plans_, iter->second);
+        return *iter->second;
+    }
+
+    void put(const std::shared_ptr<ExecutionPlan> &plan)
+    {
+        auto iter = index_.find(plan->key);
+        if (iter != index_.end())
+        {
+            plans_.erase(iter->second);
+            index_.erase(iter);
+        }
+
+        plans_.push_front(plan);
+        index_[plan->key] = plans_.begin();
+        while (plans_.size() > capacity_)
+        {
+            index_.erase(plans_.back()->key);
+            plans_.pop_back();
+        }
+    }
+
+    void clear()
+    {
+        index_.clear();
+        plans_.clear();
+    }
+
+    inline size_t size() const { return plans_.size(); }
+
+private:
+    size_t capacity_;
+    std::list<std::shared_ptr<ExecutionPlan>> plans_;
+    std::unordered_map<PlanKey, std::list<std::shared_ptr<ExecutionPlan>>::iterator, PlanKeyHash> index_;
+};
+
+}
+
+#endif
@@ -0,0 +1,75 @@
+#include "model/rounds.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+
+namespace yolo
+{
+
+std::vector<std::tuple<int, int>> split_rounds(int num_image, int max_batch)
+{
+    std::vector<std::tuple<int, int>> rounds;
+    if (max_batch <= 0) return rounds;
+    for (int ibegin = 0; ibegin < num_image; ibegin += max_batch)
+        rounds.emplace_back(ibegin, std::min(max_batch, num_image - ibegin));
+    return rounds;
+}
+
+int engine_max_batch(TensorRT::Engine &engine)
+{
+    return std::max(1, engine.max_dims(0)[0]);
+}
+
+std::vector<int> round_dims(TensorRT::Engine &engine, int batch)
+{
+    auto input_dims = engine.static_dims(0);
+    if (engine.has_dynamic_dim()) input_dims[0] = batch;
+    return input_dims;
+}
+
+bool run_rounds(
+    TensorRT::Engine &engine,
+    const std::vector<std::tuple<int, int>> &rounds,
+    const std::vector<std::vector<int>> &run_dims,
+    void *input, void *output,
+    const RoundFn &preprocess, const RoundFn &decode,
+    void *stream)
+{
+    bool dynamic = engine.has_dynamic_dim();
+    for (size_t iround = 0; iround < rounds.size(); ++iround)
+    {
+        int ibegin, num_round;
+        std::tie(ibegin, num_round) = rounds[iround];
+        if (dynamic && !engine.set_run_dims(0, run_dims[iround]))
+        {
+            printf("Fail to set run dims\n");
+            return false;
+        }
+
+        if (!preprocess(ibegin, num_round)) return false;
+
+        #ifdef TRT10
+        if (!engine.forward(std::unordered_map<std::string, const void *>{
+                { "images", input },
+                { "output0", output }
+            }, stream))
+        {
+            printf("Failed to tensorRT forward.");
+            return false;
+        }
+        #else
+        std::vector<void *> bindings{input, output};
+        if (!engine.forward(bindings, stream))
+        {
+            printf("Failed to tensorRT forward.");
+            return false;
+        }
+        #endif
+
+        if (!decode(ibegin, num_round)) return false;
+    }
+    return true;
+}
+
+}
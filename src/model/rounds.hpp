@@ -0,0 +1,45 @@
+#ifndef ROUNDS_HPP__
+#define ROUNDS_HPP__
+
+#include <functional>
+#include <tuple>
+#include <vector>
+
+#ifdef TRT10
+#include "common/tensorrt.hpp"
+namespace TensorRT = TensorRT10;
+#else
+#include "common/tensorrt8.hpp"
+namespace TensorRT = TensorRT8;
+#endif
+
+namespace yolo
+{
+
+// split num_image tiles into rounds of at most max_batch tiles, each item is {first tile, number of tiles}
+std::vector<std::tuple<int, int>> split_rounds(int num_image, int max_batch);
+
+// largest batch of the engine input, kMAX of the optimization profile or the static batch
+int engine_max_batch(TensorRT::Engine &engine);
+
+// engine input dims for a round of batch tiles, a static engine always runs its full batch
+std::vector<int> round_dims(TensorRT::Engine &engine, int batch);
+
+// work of one round around the engine, tiles [ibegin, ibegin + num_round) of the batch
+typedef std::function<bool(int ibegin, int num_round)> RoundFn;
+
+// Host only, no cuda required.
+// Runs the rounds one after the other through the same input and output buffers: preprocess fills input
+// with the tiles of the round, the engine is run with the dims of the round, decode appends what the round
+// found to the results of the earlier rounds. Stops at the first failure.
+bool run_rounds(
+    TensorRT::Engine &engine,
+    const std::vector<std::tuple<int, int>> &rounds,
+    const std::vector<std::vector<int>> &run_dims,
+    void *input, void *output,
+    const RoundFn &preprocess, const RoundFn &decode,
+    void *stream = nullptr);
+
+}
+
+#endif
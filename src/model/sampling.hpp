@@ -0,0 +1,84 @@
+#ifndef SAMPLING_HPP__
+#define SAMPLING_HPP__
+
+#include "model/affine.hpp"
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace affine
+{
+
+// per column and per row sampling positions and weights of an axis aligned warp (letterbox, resize).
+// such a warp is separable, so dst_width + dst_height entries describe every pixel of the output.
+// Host warps only: Infer preprocesses on the device with either slice backend and does not use the tables.
+struct SamplingTable
+{
+    int src_width  = 0;
+    int src_height = 0;
+    int dst_width  = 0;
+    int dst_height = 0;
+    float matrix[6];
+
+    // byte offset of the left and right source pixel in a row, -1 where the sample takes the border value
+    std::vector<int> x_low, x_high;
+    std::vector<float> lx, hx;
+    // the column samples outside the image
+    std::vector<char> x_out;
+
+    // source rows above and below, -1 where the sample takes the border value
+    std::vector<int> y_low, y_high;
+    std::vector<float> ly, hy;
+    std::vector<char> y_out;
+
+    // false if the matrix rotates or shears
+    bool build(int src_width, int src_height, int dst_width, int dst_height, const float *matrix_2_3);
+};
+
+struct SamplingKey
+{
+    int src_width, src_height, dst_width, dst_height;
+    float matrix[6];
+
+    bool operator==(const SamplingKey &other) const;
+};
+
+struct SamplingKeyHash
+{
+    size_t operator()(const SamplingKey &key) const;
+};
+
+// tables of the last few geometries, a fixed camera builds its tables once and reuses them every frame
+class SamplingTableCache
+{
+public:
+    explicit SamplingTableCache(size_t capacity = 8) : capacity_(capacity) {}
+
+    // the table of the geometry, built on first use. nullptr if the matrix is not separable
+    std::shared_ptr<const SamplingTable> get(int src_width, int src_height, int dst_width, int dst_height,
+                                             const float *matrix_2_3);
+
+    void clear();
+
+    inline size_t size() const { return tables_.size(); }
+
+private:
+    typedef std::pair<SamplingKey, std::shared_ptr<const SamplingTable>> Entry;
+
+    size_t capacity_;
+    std::list<Entry> tables_;
+    std::unordered_map<SamplingKey, std::list<Entry>::iterator, SamplingKeyHash> index_;
+};
+
+// warp of one image through its table, same results as warp_affine_pixel with the table's matrix.
+// src has the table's source size, dst is of the selected output type
+typedef void (*WarpTableHostFn)(const SamplingTable &table, const uint8_t *src, int src_line_size, void *dst,
+                                uint8_t const_value, const Norm &norm);
+
+WarpTableHostFn select_warp_table_host(const Norm &norm, OutputType type = OutputType::Float32,
+                                       OutputLayout layout = OutputLayout::Planar);
+
+}
+
+#endif
@@ -0,0 +1,168 @@
+#include "model/sampling.hpp"
+#include <cstring>
+#include <functional>
+
+namespace affine
+{
+
+// the same float expressions as warp_affine_pixel with the cross terms of the matrix at zero,
+// so a table warp gives the bits of the per pixel warp
+static void build_axis(int src_size, int dst_size, float scale, float offset, int step,
+                       std::vector<int> &low, std::vector<int> &high, std::vector<float> &l,
+                       std::vector<float> &h, std::vector<char> &out)
+{
+    low.resize(dst_size);
+    high.resize(dst_size);
+    l.resize(dst_size);
+    h.resize(dst_size);
+    out.resize(dst_size);
+    for (int d = 0; d < dst_size; ++d)
+    {
+        float src = scale * d + offset;
+        out[d] = src <= -1 || src >= src_size;
+        if (out[d])
+        {
+            low[d] = high[d] = -1;
+            l[d] = 0;
+            h[d] = 1;
+            continue;
+        }
+
+        int i_low = floorf(src);
+        int i_high = i_low + 1;
+        l[d] = src - i_low;
+        h[d] = 1 - l[d];
+        low[d] = i_low >= 0 ? i_low * step : -1;
+        high[d] = i_high < src_size ? i_high * step : -1;
+    }
+}
+
+bool SamplingTable::build(int src_width, int src_height, int dst_width, int dst_height, const float *matrix_2_3)
+{
+    if (matrix_2_3[1] != 0 || matrix_2_3[3] != 0) return false;
+
+    this->src_width  = src_width;
+    this->src_height = src_height;
+    this->dst_width  = dst_width;
+    this->dst_height = dst_height;
+    memcpy(matrix, matrix_2_3, sizeof(matrix));
+
+    build_axis(src_width, dst_width, matrix[0], matrix[2], 3, x_low, x_high, lx, hx, x_out);
+    build_axis(src_height, dst_height, matrix[4], matrix[5], 1, y_low, y_high, ly, hy, y_out);
+    return true;
+}
+
+bool SamplingKey::operator==(const SamplingKey &other) const
+{
+    return src_width == other.src_width && src_height == other.src_height && dst_width == other.dst_width &&
+           dst_height == other.dst_height && memcmp(matrix, other.matrix, sizeof(matrix)) == 0;
+}
+
+size_t SamplingKeyHash::operator()(const SamplingKey &key) const
+{
+    size_t seed = 0;
+    auto combine = [&seed](size_t value) { seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2); };
+    combine(std::hash<int>()(key.src_width));
+    combine(std::hash<int>()(key.src_height));
+    combine(std::hash<int>()(key.dst_width));
+    combine(std::hash<int>()(key.dst_height));
+    for (float value : key.matrix)
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        combine(std::hash<uint32_t>()(bits));
+    }
+    return seed;
+}
+
+std::shared_ptr<const SamplingTable> SamplingTableCache::get(int src_width, int src_height, int dst_width,
+                                                             int dst_height, const float *matrix_2_3)
+{
+    SamplingKey key;
+    key.src_width  = src_width;
+    key.src_height = src_height;
+    key.dst_width  = dst_width;
+    key.dst_height = dst_height;
+    memcpy(key.matrix, matrix_2_3, sizeof(key.matrix));
+
+    auto iter = index_.find(key);
+    if (iter != index_.end())
+    {
+        tables_.splice(tables_.begin(), tables_, iter->second);
+        return iter->second->second;
+    }
+
+    auto table = std::make_shared<SamplingTable>();
+    if (!table->build(src_width, src_height, dst_width, dst_height, matrix_2_3)) return nullptr;
+
+    tables_.emplace_front(key, table);
+    index_[key] = tables_.begin();
+    while (tables_.size() > capacity_)
+    {
+        index_.erase(tables_.back().first);
+        tables_.pop_back();
+    }
+    return table;
+}
+
+void SamplingTableCache::clear()
+{
+    index_.clear();
+    tables_.clear();
+}
+
+template <NormType N, ChannelType C, typename T, OutputLayout L>
+static void warp_table_host(const SamplingTable &table, const uint8_t *src, int src_line_size, void *dst,
+                            uint8_t const_value_st, const Norm &norm)
+{
+    const int dst_width = table.dst_width, dst_height = table.dst_height;
+    const uint8_t const_value[] = {const_value_st, const_value_st, const_value_st};
+
+    #pragma omp parallel for schedule(static)
+    for (int dy = 0; dy < dst_height; ++dy)
+    {
+        const uint8_t *row_low  = table.y_low[dy] >= 0 ? src + (size_t)table.y_low[dy] * src_line_size : nullptr;
+        const uint8_t *row_high = table.y_high[dy] >= 0 ? src + (size_t)table.y_high[dy] * src_line_size : nullptr;
+        const float ly = table.ly[dy], hy = table.hy[dy];
+        const bool y_out = table.y_out[dy];
+
+        for (int dx = 0; dx < dst_width; ++dx)
+        {
+            float c0, c1, c2;
+            if (y_out || table.x_out[dx])
+            {
+                c0 = c1 = c2 = const_value_st;
+            }
+            else
+            {
+                const int x_low = table.x_low[dx], x_high = table.x_high[dx];
+                const float lx = table.lx[dx], hx = table.hx[dx];
+                float w1 = hy * hx, w2 = hy * lx, w3 = ly * hx, w4 = ly * lx;
+                const uint8_t *v1 = row_low && x_low >= 0 ? row_low + x_low : const_value;
+                const uint8_t *v2 = row_low && x_high >= 0 ? row_low + x_high : const_value;
+                const uint8_t *v3 = row_high && x_low >= 0 ? row_high + x_low : const_value;
+                const uint8_t *v4 = row_high && x_high >= 0 ? row_high + x_high : const_value;
+
+                // same to opencv
+                c0 = floorf(w1 * v1[0] + w2 * v2[0] + w3 * v3[0] + w4 * v4[0] + 0.5f);
+                c1 = floorf(w1 * v1[1] + w2 * v2[1] + w3 * v3[1] + w4 * v4[1] + 0.5f);
+                c2 = floorf(w1 * v1[2] + w2 * v2[2] + w3 * v3[2] + w4 * v4[2] + 0.5f);
+            }
+            normalize_pixel<N, C>(norm, c0, c1, c2);
+            store_pixel<T, L>((T *)dst, dst_width, dst_height, dx, dy, c0, c1, c2);
+        }
+    }
+}
+
+template <NormType N, ChannelType C, typename T, OutputLayout L>
+struct WarpTableSelect
+{
+    static WarpTableHostFn get() { return warp_table_host<N, C, T, L>; }
+};
+
+WarpTableHostFn select_warp_table_host(const Norm &norm, OutputType type, OutputLayout layout)
+{
+    return dispatch_warp<WarpTableSelect>(norm, type, layout);
+}
+
+}
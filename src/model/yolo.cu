@@ -1,25 +1,28 @@
 #include "model/yolo.hpp"
 #include <vector>
 #include <memory>
+#include <tuple>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
 #include "slice/slice.hpp"
 #include "model/affine.hpp"
+#include "model/plan.hpp"
+#include "model/nms.hpp"
+#include "model/rounds.hpp"
 #include "common/check.hpp"
 
-#ifdef TRT10
-#include "common/tensorrt.hpp"
-namespace TensorRT = TensorRT10;
-#else
-#include "common/tensorrt8.hpp"
-namespace TensorRT = TensorRT8;
-#endif
-
 #define GPU_BLOCK_THREADS 512
 
 namespace yolo
 {
 
-static const int NUM_BOX_ELEMENT = 8;  // left, top, right, bottom, confidence, class, keepflag, row_index(output)
-static const int MAX_IMAGE_BOXES = 1024 * 4;
+static const int NUM_BOX_ELEMENT = 9;  // left, top, right, bottom, confidence, class, keepflag, row_index(output), slice_index
+static const int DEFAULT_MAX_IMAGE_BOXES = 1024 * 4;
 
 static dim3 grid_dims(int numJobs){
   int numBlockThreads = numJobs < GPU_BLOCK_THREADS ? numJobs : GPU_BLOCK_THREADS;
@@ -30,21 +33,45 @@ static dim3 block_dims(int numJobs){
   return numJobs < GPU_BLOCK_THREADS ? numJobs : GPU_BLOCK_THREADS;
 }
 
-static __host__ __device__ void affine_project(float *matrix, float x, float y, float *ox, float *oy) 
+static __host__ __device__ void affine_project(const float *matrix, float x, float y, float *ox, float *oy) 
 {
     *ox = matrix[0] * x + matrix[1] * y + matrix[2];
     *oy = matrix[3] * x + matrix[4] * y + matrix[5];
 }
 
+// roi == nullptr accepts everything
+static __device__ bool inside_roi(const uint8_t *roi, int roi_cols, int roi_rows, int roi_cell, float x, float y)
+{
+    if (roi == nullptr) return true;
+    if (x < 0 || y < 0) return false;
+
+    int col = x / roi_cell;
+    int row = y / roi_cell;
+    if (col >= roi_cols || row >= roi_rows) return false;
+    return roi[row * roi_cols + col] != 0;
+}
+
+// device twin of slice::ownsBox
+static __device__ bool owns_box(const float *core, float left, float top, float right, float bottom)
+{
+    float cx = (left + right) * 0.5f;
+    float cy = (top + bottom) * 0.5f;
+    return cx >= core[0] && cy >= core[1] && cx < core[2] && cy < core[3];
+}
+
+// one launch decodes a whole round, blockIdx.y is the batch item and slices[blockIdx.y] its slice,
+// which selects the matrix, start point and core of the item
 static __global__ void decode_kernel_v5(float *predict, int num_bboxes, int num_classes,
-                                              int output_cdim, float confidence_threshold,
-                                              float *invert_affine_matrix, float *parray, int *box_count,
-                                              int max_image_boxes, int start_x, int start_y) 
+                                              int output_cdim, size_t output_numel, float confidence_threshold,
+                                              const int *slices, const float *affine_matrices, const int *start_points,
+                                              const float *cores, float *parray, int *box_count, int max_image_boxes,
+                                              const uint8_t *roi, int roi_cols, int roi_rows, int roi_cell) 
 {
     int position = blockDim.x * blockIdx.x + threadIdx.x;
     if (position >= num_bboxes) return;
 
-    float *pitem = predict + output_cdim * position;
+    int slice_index = slices[blockIdx.y];
+    float *pitem = predict + blockIdx.y * output_numel + output_cdim * position;
     float objectness = pitem[4];
     if (objectness < confidence_threshold) return;
 
@@ -63,9 +90,6 @@ static __global__ void decode_kernel_v5(float *predict, int num_bboxes, int num_
     confidence *= objectness;
     if (confidence < confidence_threshold) return;
     
-    int index = atomicAdd(box_count, 1);
-    if (index >= max_image_boxes) return;
-
     float cx = *pitem++;
     float cy = *pitem++;
     float width = *pitem++;
@@ -74,29 +98,42 @@ static __global__ void decode_kernel_v5(float *predict, int num_bboxes, int num_
     float top = cy - height * 0.5f;
     float right = cx + width * 0.5f;
     float bottom = cy + height * 0.5f;
+    const float *invert_affine_matrix = affine_matrices + slice_index * 6;
     affine_project(invert_affine_matrix, left, top, &left, &top);
     affine_project(invert_affine_matrix, right, bottom, &right, &bottom);
+    left += start_points[slice_index * 2];
+    top += start_points[slice_index * 2 + 1];
+    right += start_points[slice_index * 2];
+    bottom += start_points[slice_index * 2 + 1];
+    if (!inside_roi(roi, roi_cols, roi_rows, roi_cell, (left + right) * 0.5f, (top + bottom) * 0.5f)) return;
+    if (cores != nullptr && !owns_box(cores + slice_index * 4, left, top, right, bottom)) return;
+
+    int index = atomicAdd(box_count, 1);
+    if (index >= max_image_boxes) return;
 
     float *pout_item = parray + index * NUM_BOX_ELEMENT;
-    *pout_item++ = left + start_x;
-    *pout_item++ = top + start_y;
-    *pout_item++ = right + start_x;
-    *pout_item++ = bottom + start_y;
+    *pout_item++ = left;
+    *pout_item++ = top;
+    *pout_item++ = right;
+    *pout_item++ = bottom;
     *pout_item++ = confidence;
     *pout_item++ = label;
     *pout_item++ = 1;  // 1 = keep, 0 = ignore
     *pout_item++ = position;
+    *pout_item++ = slice_index;
 }
 
 static __global__ void decode_kernel_v8(float *predict, int num_bboxes, int num_classes,
-                                              int output_cdim, float confidence_threshold,
-                                              float *invert_affine_matrix, float *parray, int *box_count,
-                                              int max_image_boxes, int start_x, int start_y) 
+                                              int output_cdim, size_t output_numel, float confidence_threshold,
+                                              const int *slices, const float *affine_matrices, const int *start_points,
+                                              const float *cores, float *parray, int *box_count, int max_image_boxes,
+                                              const uint8_t *roi, int roi_cols, int roi_rows, int roi_cell) 
 {
     int position = blockDim.x * blockIdx.x + threadIdx.x;
     if (position >= num_bboxes) return;
 
-    float *pitem = predict + output_cdim * position;
+    int slice_index = slices[blockIdx.y];
+    float *pitem = predict + blockIdx.y * output_numel + output_cdim * position;
     float *class_confidence = pitem + 4;
     float confidence = *class_confidence++;
     int label = 0;
@@ -110,9 +147,6 @@ static __global__ void decode_kernel_v8(float *predict, int num_bboxes, int num_
     }
     if (confidence < confidence_threshold) return;
 
-    int index = atomicAdd(box_count, 1);
-    if (index >= max_image_boxes) return;
-
     float cx = *pitem++;
     float cy = *pitem++;
     float width = *pitem++;
@@ -121,101 +155,96 @@ static __global__ void decode_kernel_v8(float *predict, int num_bboxes, int num_
     float top = cy - height * 0.5f;
     float right = cx + width * 0.5f;
     float bottom = cy + height * 0.5f;
+    const float *invert_affine_matrix = affine_matrices + slice_index * 6;
     affine_project(invert_affine_matrix, left, top, &left, &top);
     affine_project(invert_affine_matrix, right, bottom, &right, &bottom);
+    left += start_points[slice_index * 2];
+    top += start_points[slice_index * 2 + 1];
+    right += start_points[slice_index * 2];
+    bottom += start_points[slice_index * 2 + 1];
+    if (!inside_roi(roi, roi_cols, roi_rows, roi_cell, (left + right) * 0.5f, (top + bottom) * 0.5f)) return;
+    if (cores != nullptr && !owns_box(cores + slice_index * 4, left, top, right, bottom)) return;
+
+    int index = atomicAdd(box_count, 1);
+    if (index >= max_image_boxes) return;
 
     float *pout_item = parray + index * NUM_BOX_ELEMENT;
-    *pout_item++ = left + start_x;
-    *pout_item++ = top + start_y;
-    *pout_item++ = right + start_x;
-    *pout_item++ = bottom + start_y;
+    *pout_item++ = left;
+    *pout_item++ = top;
+    *pout_item++ = right;
+    *pout_item++ = bottom;
     *pout_item++ = confidence;
     *pout_item++ = label;
     *pout_item++ = 1;  // 1 = keep, 0 = ignore
     *pout_item++ = position;
+    *pout_item++ = slice_index;
 }
 
 
-static __device__ float box_iou(float aleft, float atop, float aright, float abottom, float bleft,
-                                float btop, float bright, float bbottom)
-{
-    float cleft = max(aleft, bleft);
-    float ctop = max(atop, btop);
-    float cright = min(aright, bright);
-    float cbottom = min(abottom, bbottom);
-
-    float c_area = max(cright - cleft, 0.0f) * max(cbottom - ctop, 0.0f);
-    if (c_area == 0.0f) return 0.0f;
-
-    float a_area = max(0.0f, aright - aleft) * max(0.0f, abottom - atop);
-    float b_area = max(0.0f, bright - bleft) * max(0.0f, bbottom - btop);
-    return c_area / (a_area + b_area - c_area);
-}
-
-
-static __global__ void fast_nms_kernel(float *bboxes, int* box_count, int max_image_boxes, float threshold) 
-{
-    int position = (blockDim.x * blockIdx.x + threadIdx.x);
-    int count = min((int)*box_count, MAX_IMAGE_BOXES);
-    if (position >= count) return;
-
-    // left, top, right, bottom, confidence, class, keepflag
-    float *pcurrent = bboxes + position * NUM_BOX_ELEMENT;
-    for (int i = 0; i < count; ++i) 
-    {
-        float *pitem = bboxes + i * NUM_BOX_ELEMENT;
-        if (i == position || pcurrent[5] != pitem[5]) continue;
-
-        if (pitem[4] >= pcurrent[4]) 
-        {
-            if (pitem[4] == pcurrent[4] && i < position) continue;
-
-            float iou = box_iou(pcurrent[0], pcurrent[1], pcurrent[2], pcurrent[3], pitem[0], pitem[1],
-                                pitem[2], pitem[3]);
-
-            if (iou > threshold) 
-            {
-                pcurrent[6] = 0;  // 1=keep, 0=ignore
-                return;
-            }
-        }
-    }
-}
-
 static void decode_kernel_invoker_v8(float *predict, int num_bboxes, int num_classes, int output_cdim,
-                                  float confidence_threshold, float nms_threshold,
-                                  float *invert_affine_matrix, float *parray, int* box_count, int max_image_boxes,
-                                  int start_x, int start_y, cudaStream_t stream) 
+                                  size_t output_numel, int num_round, float confidence_threshold,
+                                  const int *slices, const float *affine_matrices, const int *start_points,
+                                  const float *cores, float *parray, int* box_count, int max_image_boxes,
+                                  const uint8_t *roi, int roi_cols, int roi_rows, int roi_cell, cudaStream_t stream) 
 {
-    auto grid = grid_dims(num_bboxes);
+    dim3 grid(grid_dims(num_bboxes).x, num_round);
     auto block = block_dims(num_bboxes);
 
     checkKernel(decode_kernel_v8<<<grid, block, 0, stream>>>(
-            predict, num_bboxes, num_classes, output_cdim, confidence_threshold, invert_affine_matrix,
-            parray, box_count, max_image_boxes, start_x, start_y));
+            predict, num_bboxes, num_classes, output_cdim, output_numel, confidence_threshold,
+            slices, affine_matrices, start_points, cores, parray, box_count, max_image_boxes,
+            roi, roi_cols, roi_rows, roi_cell));
 }
 
 
 static void decode_kernel_invoker_v5(float *predict, int num_bboxes, int num_classes, int output_cdim,
-                                  float confidence_threshold, float nms_threshold,
-                                  float *invert_affine_matrix, float *parray, int* box_count, int max_image_boxes,
-                                  int start_x, int start_y, cudaStream_t stream) 
+                                  size_t output_numel, int num_round, float confidence_threshold,
+                                  const int *slices, const float *affine_matrices, const int *start_points,
+                                  const float *cores, float *parray, int* box_count, int max_image_boxes,
+                                  const uint8_t *roi, int roi_cols, int roi_rows, int roi_cell, cudaStream_t stream) 
 {
-    auto grid = grid_dims(num_bboxes);
+    dim3 grid(grid_dims(num_bboxes).x, num_round);
     auto block = block_dims(num_bboxes);
 
     checkKernel(decode_kernel_v5<<<grid, block, 0, stream>>>(
-            predict, num_bboxes, num_classes, output_cdim, confidence_threshold, invert_affine_matrix,
-            parray, box_count, max_image_boxes, start_x, start_y));
+            predict, num_bboxes, num_classes, output_cdim, output_numel, confidence_threshold,
+            slices, affine_matrices, start_points, cores, parray, box_count, max_image_boxes,
+            roi, roi_cols, roi_rows, roi_cell));
 }
 
-static void fast_nms_kernel_invoker(float *parray, int* box_count, int max_image_boxes, float nms_threshold, cudaStream_t stream)
+// rows of the downloaded box array that survived nms
+static BoxArray parse_boxes(const float *parray, int count)
 {
-    auto grid = grid_dims(max_image_boxes);
-    auto block = block_dims(max_image_boxes);
-    checkKernel(fast_nms_kernel<<<grid, block, 0, stream>>>(parray, box_count, max_image_boxes, nms_threshold));
+    BoxArray result;
+    for (int i = 0; i < count; ++i) 
+    {
+        const float *pbox = parray + i * NUM_BOX_ELEMENT;
+        int label = pbox[5];
+        int keepflag = pbox[6];
+        if (keepflag == 1) {
+            Box result_object_box(pbox[0], pbox[1], pbox[2], pbox[3], pbox[4], label);
+            result.emplace_back(result_object_box);
+        }
+    }
+    return result;
 }
 
+// host side of a forward_async request. the device buffers are shared and ordered by the stream,
+// the pinned sources of its uploads and the destinations of its downloads are its own
+struct AsyncRequest
+{
+    tensor::Memory<int> slices;
+    tensor::Memory<affine::WarpTile> tiles;
+    tensor::Memory<float> cores;
+    tensor::Memory<float> boxarray;
+    tensor::Memory<int> box_count;
+    int max_boxes = 0;      // rows of boxarray filled by the device
+    // the device copies of the plan are read until done, even if the cache evicts the plan meanwhile
+    std::shared_ptr<ExecutionPlan> plan;
+    cudaEvent_t done = nullptr;
+    std::shared_future<BoxArray> result;
+};
+
 class YoloModelImpl : public Infer 
 {
 public:
@@ -228,66 +257,328 @@ public:
 
     tensor::Memory<int> box_count_;
 
-    tensor::Memory<float> affine_matrix_;
-    tensor::Memory<float>  input_buffer_, bbox_predict_, output_boxarray_;
+    tensor::Memory<float>  bbox_predict_, output_boxarray_;
+    // raw bytes, the element type follows the engine input (input_type_)
+    tensor::Memory<unsigned char> input_buffer_;
+    tensor::Memory<int> batch_slices_;
+    tensor::Memory<affine::WarpTile> batch_tiles_;
+    // cores of the frame when the slice filter skipped slices next to inferred ones
+    tensor::Memory<float> active_cores_;
+    // capacity of output_boxarray_, nms_workspace_ is grown to it by the first nms
+    nms::Workspace nms_workspace_;
+    int max_boxes_ = DEFAULT_MAX_IMAGE_BOXES;
 
     int network_input_width_, network_input_height_;
     affine::Norm normalize_;
+    // warp kernels specialized on normalize_ and the engine input type and layout, selected once in load
+    affine::OutputType input_type_ = affine::OutputType::Float32;
+    affine::OutputLayout input_layout_ = affine::OutputLayout::Planar;
+    affine::WarpKernels warp_;
     std::vector<int> bbox_head_dims_;
     bool isdynamic_model_ = false;
+    int max_batch_size_ = 1;
+    slice::SlicePlanner planner_;
+
+    // execution plans keyed on frame geometry, current_plan_ is the one of the last sliced frame
+    PlanCache plans_;
+    std::shared_ptr<ExecutionPlan> current_plan_;
+
+    // infer the letterboxed full frame in the same batch as the slices
+    bool full_frame_ = false;
+
+    // region of interest of the stream, baked into every plan
+    slice::Roi roi_;
+
+    // decode keeps a box only in the slice whose core holds its centre
+    bool tile_ownership_ = false;
+
+    // edge slices are shifted back inside the frame like sahi, otherwise they are cropped and smaller
+    bool shift_edges_ = true;
+
+    // slices of the current plan that go through the engine
+    slice::SliceFilter slice_filter_;
+    std::vector<int> active_slices_;
+    ForwardStats stats_;
+
+    // video mode, unchanged slices reuse their candidates (before nms) from the last time they were inferred
+    slice::MotionGate motion_gate_;
+    std::shared_ptr<ExecutionPlan> gated_plan_;
+    std::vector<std::vector<float>> slice_boxes_;
+    std::vector<char> slice_cached_;
+    std::vector<float> slice_differences_;
+    std::vector<int> reused_slices_;
+    int frame_index_ = 0;
+
+    // second passes (coarse to fine, subdivision of dense slices) run tiles chosen from the first pass.
+    // carried_boxes_ are rows of the first pass that join the nms of the second
+    std::shared_ptr<ExecutionPlan> tile_plan_;
+    std::vector<float> carried_boxes_;
+    slice::SubdivisionPolicy subdivision_;
+
 
     float confidence_threshold_;
     float nms_threshold_;
 
     int num_classes_ = 0;
 
-    virtual ~YoloModelImpl() = default;
+    // forward_async, requests are reused round robin and finished in order by completion_
+    AsyncRequest requests_[MAX_ASYNC_REQUESTS];
+    int next_request_ = 0;
+    std::thread completion_;
+    std::mutex completion_lock_;
+    std::condition_variable completion_cv_;
+    std::deque<std::pair<AsyncRequest *, std::promise<BoxArray>>> completion_queue_;
+    bool completion_stop_ = false;
 
-    void adjust_memory(int batch_size) 
+    virtual ~YoloModelImpl()
     {
-        // the inference batch_size
-        size_t input_numel = network_input_width_ * network_input_height_ * 3;
-        input_buffer_.gpu(batch_size * input_numel);
-        bbox_predict_.gpu(batch_size * bbox_head_dims_[1] * bbox_head_dims_[2]);
-        output_boxarray_.gpu(MAX_IMAGE_BOXES * NUM_BOX_ELEMENT);
-        output_boxarray_.cpu(MAX_IMAGE_BOXES * NUM_BOX_ELEMENT);
+        if (completion_.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock(completion_lock_);
+                completion_stop_ = true;
+            }
+            completion_cv_.notify_one();
+            completion_.join();
+        }
+        for (auto &request : requests_)
+        {
+            if (request.done) cudaEventDestroy(request.done);
+        }
+    }
 
-        affine_matrix_.gpu(6);
-        affine_matrix_.cpu(6);
+    void adjust_memory(const ExecutionPlan &plan) 
+    {
+        // the inference batch_size
+        input_buffer_.gpu(plan.infer_batch_size * plan.input_numel * affine::output_type_size(input_type_));
+        bbox_predict_.gpu(plan.infer_batch_size * plan.output_numel);
+        output_boxarray_.gpu(max_boxes_ * NUM_BOX_ELEMENT);
+        output_boxarray_.cpu(max_boxes_ * NUM_BOX_ELEMENT);
 
         box_count_.gpu(1);
         box_count_.cpu(1);
     }
 
-    void preprocess(int ibatch, affine::LetterBoxMatrix &affine, void *stream = nullptr)
+    std::shared_ptr<ExecutionPlan> build_plan(const PlanKey &key, int slice_width, int slice_height,
+                                              float overlap_width_ratio, float overlap_height_ratio, void *stream)
+    {
+        auto plan = std::make_shared<ExecutionPlan>();
+        plan->key          = key;
+        plan->width        = key.width;
+        plan->height       = key.height;
+        plan->slice_width  = slice_width;
+        plan->slice_height = slice_height;
+        plan->full_frame   = key.full_frame;
+
+        std::vector<int> points = slice::calculateSliceStartPoints(
+            key.width, key.height, slice_width, slice_height,
+            overlap_width_ratio, overlap_height_ratio, plan->slice_num_h, plan->slice_num_v, key.shift_edges);
+        std::vector<float> cores = slice::calculateSliceCores(
+            points, plan->slice_num_h, plan->slice_num_v, slice_width, slice_height);
+
+        // only the slices touching the roi are kept, they are no longer a grid
+        if (key.roi)
+        {
+            std::vector<uint8_t> cells = slice::rasterizeRoi(roi_, key.width, key.height, plan->roi_cols, plan->roi_rows);
+            plan->roi_cell = std::max(roi_.cell, 1);
+
+            std::vector<int> kept;
+            std::vector<float> kept_cores;
+            for (size_t i = 0; i < points.size(); i += 2)
+            {
+                if (slice::roiIntersects(cells, plan->roi_cols, plan->roi_rows, plan->roi_cell,
+                                         points[i], points[i + 1], slice_width, slice_height))
+                {
+                    kept.push_back(points[i]);
+                    kept.push_back(points[i + 1]);
+                    const float *core = cores.data() + i / 2 * slice::NUM_CORE_ELEMENT;
+                    kept_cores.insert(kept_cores.end(), core, core + slice::NUM_CORE_ELEMENT);
+                }
+            }
+            points.swap(kept);
+            cores.swap(kept_cores);
+            plan->slice_num_h = (int)points.size() / 2;
+            plan->slice_num_v = 1;
+
+            uint8_t *roi_host = plan->roi_mask.cpu(cells.size());
+            memcpy(roi_host, cells.data(), cells.size());
+            checkRuntime(cudaMemcpyAsync(plan->roi_mask.gpu(cells.size()), roi_host, cells.size(),
+                                        cudaMemcpyHostToDevice, (cudaStream_t)stream));
+        }
+
+        fill_plan(*plan, points, cores, stream);
+        return plan;
+    }
+
+    // start points, matrices, cores and rounds of a plan whose geometry and slice count are set.
+    // the uploads are asynchronous, plan.uploaded guards the host copies they read.
+    // without cores the plan cannot filter by tile ownership
+    void fill_plan(ExecutionPlan &plan, std::vector<int> points, std::vector<float> cores, void *stream)
     {
-        affine.compute(std::make_tuple(slice_->slice_width_, slice_->slice_height_),
-                    std::make_tuple(network_input_width_, network_input_height_));
+        // a plan filled again (the tiles of forward_tiles) may still be uploading its previous host copies
+        if (plan.uploaded) checkRuntime(cudaEventSynchronize(plan.uploaded));
+
+        int slice_width  = plan.slice_width;
+        int slice_height = plan.slice_height;
+        int slice_num = plan.slice_num();
+        int num_image = plan.image_num();
+        points.resize(num_image * 2, 0);
+
+        int *start_point_host = plan.slice_start_point.cpu(num_image * 2);
+        memcpy(start_point_host, points.data(), num_image * 2 * sizeof(int));
+
+        // every image is letterboxed from its own size, cropped slices keep the scale of the full ones
+        plan.slice_size = slice::calculateSliceSizes(points, plan.width, plan.height, slice_width, slice_height);
+        if (plan.full_frame)
+        {
+            plan.slice_size[slice_num * 2]     = plan.width;
+            plan.slice_size[slice_num * 2 + 1] = plan.height;
+        }
 
-        size_t input_numel = network_input_width_ * network_input_height_ * 3;
-        float *input_device = input_buffer_.gpu() + ibatch * input_numel;
-        size_t size_image = slice_->slice_width_ * slice_->slice_height_ * 3;
+        float slice_scale = std::min(network_input_width_ / (float)slice_width, network_input_height_ / (float)slice_height);
+        float *affine_matrix_host = plan.affine_matrix.cpu(num_image * 6);
+        for (int i = 0; i < num_image; ++i)
+        {
+            affine::LetterBoxMatrix letterbox;
+            letterbox.compute(std::make_tuple(plan.slice_size[i * 2], plan.slice_size[i * 2 + 1]),
+                              std::make_tuple(network_input_width_, network_input_height_),
+                              i < slice_num ? slice_scale : 0.0f);
+            memcpy(affine_matrix_host + i * 6, letterbox.d2i, sizeof(letterbox.d2i));
+        }
 
-        float *affine_matrix_device = affine_matrix_.gpu();
-        uint8_t *image_device = slice_->output_images_.gpu() + ibatch * size_image;
+        // the full frame item owns everything it finds
+        plan.has_core = !cores.empty();
+        if (plan.has_core)
+        {
+            cores.resize(num_image * slice::NUM_CORE_ELEMENT, std::numeric_limits<float>::infinity());
+            if (plan.full_frame)
+            {
+                cores[slice_num * slice::NUM_CORE_ELEMENT]     = -std::numeric_limits<float>::infinity();
+                cores[slice_num * slice::NUM_CORE_ELEMENT + 1] = -std::numeric_limits<float>::infinity();
+            }
+            float *core_host = plan.slice_core.cpu(cores.size());
+            memcpy(core_host, cores.data(), cores.size() * sizeof(float));
+            checkRuntime(cudaMemcpyAsync(plan.slice_core.gpu(cores.size()), core_host, cores.size() * sizeof(float),
+                                        cudaMemcpyHostToDevice, (cudaStream_t)stream));
+        }
+
+        plan.input_numel  = network_input_width_ * network_input_height_ * 3;
+        plan.output_numel = bbox_head_dims_[1] * bbox_head_dims_[2];
 
-        float *affine_matrix_host = affine_matrix_.cpu();
+        // a static engine always consumes its full batch, a dynamic one only what the round needs
+        plan.infer_batch_size = isdynamic_model_ ? std::min(num_image, max_batch_size_) : max_batch_size_;
+        plan.rounds = split_rounds(num_image, max_batch_size_);
+        plan.run_dims.clear();
+        for (auto &round : plan.rounds)
+            plan.run_dims.emplace_back(round_dims(*trt_, std::get<1>(round)));
 
-        // speed up
         cudaStream_t stream_ = (cudaStream_t)stream;
-        memcpy(affine_matrix_host, affine.d2i, sizeof(affine.d2i));
-        checkRuntime(cudaMemcpyAsync(affine_matrix_device, affine_matrix_host, sizeof(affine.d2i),
+        checkRuntime(cudaMemcpyAsync(plan.slice_start_point.gpu(num_image * 2), start_point_host,
+                                    num_image * 2 * sizeof(int), cudaMemcpyHostToDevice, stream_));
+        checkRuntime(cudaMemcpyAsync(plan.affine_matrix.gpu(num_image * 6), affine_matrix_host,
+                                    num_image * 6 * sizeof(float), cudaMemcpyHostToDevice, stream_));
+
+        // the tiles of the previous fill read other start points
+        plan.tile_sets.clear();
+        int *all_slices_host = plan.all_slices.cpu(num_image);
+        for (int i = 0; i < num_image; ++i) all_slices_host[i] = i;
+        checkRuntime(cudaMemcpyAsync(plan.all_slices.gpu(num_image), all_slices_host, num_image * sizeof(int),
                                     cudaMemcpyHostToDevice, stream_));
 
-        affine::warp_affine_bilinear_and_normalize_plane(image_device, slice_->slice_width_ * 3, slice_->slice_width_,
-                                                slice_->slice_height_, input_device, network_input_width_,
-                                                network_input_height_, affine_matrix_device, 114,
-                                                normalize_, stream_);
+        if (plan.uploaded == nullptr) checkRuntime(cudaEventCreateWithFlags(&plan.uploaded, cudaEventDisableTiming));
+        checkRuntime(cudaEventRecord(plan.uploaded, stream_));
     }
 
-    bool load(const std::string &engine_file, YoloType yolo_type, float confidence_threshold, float nms_threshold) 
+    // device tiles of every image of the plan for the frame sliced last, built and uploaded once per frame buffer
+    // of the upload ring
+    const affine::WarpTile *plan_tiles(ExecutionPlan &plan, void *stream)
     {
-        trt_ = TensorRT::load(engine_file);
+        const uint8_t *frame  = slice_->input_image();
+        const uint8_t *slices = slice_->materialized() ? slice_->output_images_.gpu() : nullptr;
+        for (auto iter = plan.tile_sets.begin(); iter != plan.tile_sets.end(); ++iter)
+        {
+            if (iter->frame != frame || iter->slices != slices) continue;
+            plan.tile_sets.splice(plan.tile_sets.begin(), plan.tile_sets, iter);
+            return iter->tiles.gpu();
+        }
+
+        // one set per buffer of the ring, the least recent one is rebuilt once its last upload has run
+        if ((int)plan.tile_sets.size() < slice::NUM_FRAME_SLOTS)
+            plan.tile_sets.emplace_front();
+        else
+        {
+            plan.tile_sets.splice(plan.tile_sets.begin(), plan.tile_sets, std::prev(plan.tile_sets.end()));
+            checkRuntime(cudaEventSynchronize(plan.uploaded));
+        }
+
+        TileSet &set = plan.tile_sets.front();
+        set.frame  = frame;
+        set.slices = slices;
+        int num_image = plan.image_num();
+        affine::WarpTile *tiles = set.tiles.cpu(num_image);
+        for (int i = 0; i < num_image; ++i) tiles[i] = warp_tile(plan, i);
+        checkRuntime(cudaMemcpyAsync(set.tiles.gpu(num_image), tiles, num_image * sizeof(affine::WarpTile),
+                                    cudaMemcpyHostToDevice, (cudaStream_t)stream));
+        checkRuntime(cudaEventRecord(plan.uploaded, (cudaStream_t)stream));
+        return set.tiles.gpu();
+    }
+
+    // slice_width == 0 selects the grid from the SlicePlanner
+    std::shared_ptr<ExecutionPlan> get_plan(int width, int height, int slice_width, int slice_height,
+                                            float overlap_width_ratio, float overlap_height_ratio,
+                                            bool full_frame, bool roi, void *stream)
+    {
+        PlanKey key;
+        key.width  = width;
+        key.height = height;
+        if (slice_width > 0 && slice_height > 0)
+        {
+            key.slice_width  = slice_width;
+            key.slice_height = slice_height;
+            key.overlap_width_pixel  = slice::overlapPixels(slice_width, overlap_width_ratio);
+            key.overlap_height_pixel = slice::overlapPixels(slice_height, overlap_height_ratio);
+        }
+        key.full_frame = full_frame;
+        key.shift_edges = shift_edges_;
+        key.roi        = roi && roi_.enabled();
+
+        auto plan = plans_.get(key);
+        if (plan != nullptr) return plan;
+
+        if (key.slice_width == 0)
+        {
+            slice::SliceGrid grid = planner_.plan(width, height);
+            slice_width  = grid.slice_width;
+            slice_height = grid.slice_height;
+            overlap_width_ratio  = grid.overlap_width_ratio;
+            overlap_height_ratio = grid.overlap_height_ratio;
+        }
+        if (slice_width <= 0 || slice_height <= 0) return nullptr;
+
+        plan = build_plan(key, slice_width, slice_height, overlap_width_ratio, overlap_height_ratio, stream);
+        plans_.put(plan);
+        return plan;
+    }
+
+    // source view and matrix of slice islice for the batched warp
+    affine::WarpTile warp_tile(const ExecutionPlan &plan, int islice)
+    {
+        const int *start_point = plan.slice_start_point.cpu() + islice * 2;
+        const int *size = plan.slice_size.data() + islice * 2;
+        slice::TileView view = islice == plan.slice_num() ? slice_->frame()
+                                                          : slice_->tile(islice, start_point[0], start_point[1], size[0], size[1]);
+        affine::WarpTile tile;
+        tile.src           = view.data;
+        tile.src_line_size = view.line_size;
+        tile.src_width     = view.width;
+        tile.src_height    = view.height;
+        memcpy(tile.matrix, plan.affine_matrix.cpu() + islice * 6, sizeof(tile.matrix));
+        return tile;
+    }
+
+    bool load(std::shared_ptr<TensorRT::Engine> engine, YoloType yolo_type, float confidence_threshold, float nms_threshold) 
+    {
+        trt_ = engine;
         if (trt_ == nullptr) return false;
 
         trt_->print();
@@ -298,11 +589,35 @@ public:
 
         auto input_dim = trt_->static_dims(0);
         bbox_head_dims_ = trt_->static_dims(1);
-        network_input_width_ = input_dim[3];
-        network_input_height_ = input_dim[2];
-        isdynamic_model_ = trt_->has_dynamic_dim();
 
+        // n, h, w, 3 is an nhwc input, otherwise n, 3, h, w
+        input_layout_ = input_dim[3] == 3 && input_dim[1] != 3 ? affine::OutputLayout::Packed : affine::OutputLayout::Planar;
+        network_input_width_  = input_layout_ == affine::OutputLayout::Packed ? input_dim[2] : input_dim[3];
+        network_input_height_ = input_layout_ == affine::OutputLayout::Packed ? input_dim[1] : input_dim[2];
+        isdynamic_model_ = trt_->has_dynamic_dim();
+        max_batch_size_ = engine_max_batch(*trt_);
+        planner_.network_width = network_input_width_;
+        planner_.network_height = network_input_height_;
+        planner_.max_batch = max_batch_size_;
+
+        // fp16 engines take the half precision input straight from the warp, no cast layer in the graph.
+        // uint8 engines do the /255 and bgr to rgb in the graph, the warp only resizes
+        auto input_dtype = trt_->dtype(0);
         normalize_ = affine::Norm::alpha_beta(1 / 255.0f, 0.0f, affine::ChannelType::SwapRB);
+        if (input_dtype == TensorRT::DType::FLOAT) input_type_ = affine::OutputType::Float32;
+        else if (input_dtype == TensorRT::DType::HALF) input_type_ = affine::OutputType::Float16;
+        else if (input_dtype == TensorRT::DType::UINT8)
+        {
+            input_type_ = affine::OutputType::UInt8;
+            normalize_  = affine::Norm::None();
+        }
+        else
+        {
+            printf("Unsupported input dtype %d\n", (int)input_dtype);
+            return false;
+        }
+        warp_ = affine::select_warp(normalize_, input_type_, input_layout_);
+
         if (this->yolo_type_ == YoloType::YOLOV8 || this->yolo_type_ == YoloType::YOLOV11)
         {
             num_classes_ = bbox_head_dims_[2] - 4;
@@ -314,147 +629,674 @@ public:
         return true;
     }
 
+    virtual void set_slice_mode(slice::SliceMode mode) override
+    {
+        slice_->mode_ = mode;
+    }
+
+    virtual void set_slice_backend(slice::SliceBackend backend) override
+    {
+        slice_->backend_ = backend;
+    }
+
+    virtual void set_pinned_staging(bool enable) override
+    {
+        slice_->staging_ = enable;
+    }
+
+    virtual tensor::Image staging_image(int width, int height) override
+    {
+        return tensor::Image(slice_->staging_buffer(width, height), width, height);
+    }
+
+    virtual void set_slice_filter(const slice::SliceFilter &filter) override
+    {
+        slice_filter_ = filter;
+    }
+
+    virtual void set_subdivision(const slice::SubdivisionPolicy &policy) override
+    {
+        subdivision_ = policy;
+    }
+
+    virtual void set_shift_edges(bool enable) override
+    {
+        shift_edges_ = enable;
+    }
+
+    virtual void set_tile_ownership(bool enable) override
+    {
+        tile_ownership_ = enable;
+    }
+
+    virtual void set_max_boxes(int max_boxes) override
+    {
+        max_boxes_ = std::max(1, max_boxes);
+    }
+
+    virtual void set_roi(const slice::Roi &roi) override
+    {
+        roi_ = roi;
+        plans_.clear();
+    }
+
+    virtual void set_full_frame(bool enable) override
+    {
+        full_frame_ = enable;
+        slice_->upload_frame_ = enable;
+    }
+
+    virtual void set_motion_gate(const slice::MotionGate &gate) override
+    {
+        motion_gate_ = gate;
+        gated_plan_.reset();
+        frame_index_ = 0;
+    }
+
+    // moves the active slices that did not change since their last inference to reused_slices_
+    void gate_slices(void *stream)
+    {
+        const ExecutionPlan &plan = *current_plan_;
+        int slice_num = plan.image_num();
+        slice_->difference(plan.slice_start_point, motion_gate_.step, slice_differences_, stream);
+
+        // the full frame counts as unchanged only when every slice is
+        if (plan.full_frame)
+        {
+            float difference = 0;
+            for (float d : slice_differences_)
+                difference = d < 0 || difference < 0 ? -1.0f : std::max(difference, d);
+            slice_differences_.push_back(difference);
+        }
+
+        bool refresh = gated_plan_ != current_plan_ ||
+                       (motion_gate_.refresh_interval > 0 && frame_index_ % motion_gate_.refresh_interval == 0);
+        frame_index_++;
+        if (refresh)
+        {
+            gated_plan_ = current_plan_;
+            slice_boxes_.assign(slice_num, std::vector<float>());
+            slice_cached_.assign(slice_num, 0);
+        }
+
+        // slices dropped by the filter have no candidates
+        std::vector<char> active(slice_num, 0);
+        for (int islice : active_slices_) active[islice] = 1;
+        for (int islice = 0; islice < slice_num; ++islice)
+        {
+            if (active[islice]) continue;
+            slice_boxes_[islice].clear();
+            slice_cached_[islice] = 1;
+        }
+
+        std::vector<int> inferred;
+        for (int islice : active_slices_)
+        {
+            float difference = slice_differences_[islice];
+            if (slice_cached_[islice] && difference >= 0 && difference < motion_gate_.threshold)
+                reused_slices_.push_back(islice);
+            else
+                inferred.push_back(islice);
+        }
+        active_slices_.swap(inferred);
+        stats_.reused_slices = (int)reused_slices_.size();
+    }
+
+    // puts the carried rows and the cached candidates of the reused slices at the head of output_boxarray_,
+    // returns their number
+    int upload_reused_boxes(void *stream)
+    {
+        float *parray = output_boxarray_.cpu();
+        int count = std::min((int)carried_boxes_.size() / NUM_BOX_ELEMENT, max_boxes_);
+        memcpy(parray, carried_boxes_.data(), count * NUM_BOX_ELEMENT * sizeof(float));
+        for (int i = 0; i < count; ++i) parray[i * NUM_BOX_ELEMENT + 6] = 1;
+        for (int islice : reused_slices_)
+        {
+            const std::vector<float> &boxes = slice_boxes_[islice];
+            int num = std::min((int)boxes.size() / NUM_BOX_ELEMENT, max_boxes_ - count);
+            memcpy(parray + count * NUM_BOX_ELEMENT, boxes.data(), num * NUM_BOX_ELEMENT * sizeof(float));
+            for (int i = count; i < count + num; ++i) parray[i * NUM_BOX_ELEMENT + 6] = 1;
+            count += num;
+        }
+
+        cudaStream_t stream_ = (cudaStream_t)stream;
+        *box_count_.cpu() = count;
+        if (count > 0)
+        {
+            checkRuntime(cudaMemcpyAsync(output_boxarray_.gpu(), parray, count * NUM_BOX_ELEMENT * sizeof(float),
+                                        cudaMemcpyHostToDevice, stream_));
+        }
+        checkRuntime(cudaMemcpyAsync(box_count_.gpu(), box_count_.cpu(), sizeof(int), cudaMemcpyHostToDevice, stream_));
+        return count;
+    }
+
+    // remembers the candidates of the slices inferred in this frame
+    void update_slice_boxes(const float *parray, int count)
+    {
+        std::vector<char> inferred(slice_boxes_.size(), 0);
+        for (int islice : active_slices_)
+        {
+            inferred[islice] = 1;
+            slice_boxes_[islice].clear();
+            slice_cached_[islice] = 1;
+        }
+
+        for (int i = 0; i < count; ++i)
+        {
+            const float *pbox = parray + i * NUM_BOX_ELEMENT;
+            int islice = pbox[8];
+            if (inferred[islice]) slice_boxes_[islice].insert(slice_boxes_[islice].end(), pbox, pbox + NUM_BOX_ELEMENT);
+        }
+    }
+
+    virtual ForwardStats stats() override
+    {
+        return stats_;
+    }
+
+    virtual bool prepare(int width, int height, int slice_width, int slice_height, float overlap_width_ratio, float overlap_height_ratio, void *stream = nullptr) override
+    {
+        return get_plan(width, height, slice_width, slice_height, overlap_width_ratio, overlap_height_ratio, full_frame_, true, stream) != nullptr;
+    }
+
+    virtual bool prepare(int width, int height, void *stream = nullptr) override
+    {
+        return get_plan(width, height, 0, 0, 0.0f, 0.0f, full_frame_, true, stream) != nullptr;
+    }
 
     virtual BoxArray forward(const tensor::Image &image, int slice_width, int slice_height, float overlap_width_ratio, float overlap_height_ratio, void *stream = nullptr) override 
     {
-        slice_->slice(image, slice_width, slice_height, overlap_width_ratio, overlap_height_ratio, stream);
-        return forwards(stream);
+        current_plan_ = get_plan(image.width, image.height, slice_width, slice_height, overlap_width_ratio, overlap_height_ratio, full_frame_, true, stream);
+        return forward_plan(image, motion_gate_.enabled, stream);
     }
 
-    virtual BoxArray forward(const tensor::Image &image, void *stream = nullptr) override 
+    // slices image with current_plan_ and runs it
+    BoxArray forward_plan(const tensor::Image &image, bool gate, void *stream)
     {
-        slice_->autoSlice(image, stream);
-        return forwards(stream);
+        if (!slice_plan(image, gate, stream)) return {};
+
+        BoxArray result = forwards(stream);
+        if (subdivision_.enabled) result = forward_dense(std::move(result), stream);
+        return result;
     }
 
-    virtual BoxArray forwards(void *stream = nullptr) override 
+    // slices image with current_plan_ and chooses the slices to infer, false when the plan has nothing to run
+    bool slice_plan(const tensor::Image &image, bool gate, void *stream)
+    {
+        if (current_plan_ == nullptr || current_plan_->image_num() == 0) return false;
+
+        slice_->slice(image, current_plan_->slice_width, current_plan_->slice_height,
+                      current_plan_->slice_num_h, current_plan_->slice_num_v,
+                      current_plan_->slice_start_point, stream);
+
+        stats_ = ForwardStats();
+        stats_.slices = current_plan_->slice_num();
+        stats_.skipped_slices = slice_->select(slice_filter_, current_plan_->slice_start_point, active_slices_, stream);
+        if (current_plan_->full_frame) active_slices_.push_back(current_plan_->slice_num());
+
+        reused_slices_.clear();
+        carried_boxes_.clear();
+        if (gate) gate_slices(stream);
+        return true;
+    }
+
+    virtual BoxArray forward_refine(const tensor::Image &image, const slice::RefineOptions &options, void *stream = nullptr) override
     {
-        int num_image = slice_->slice_num_h_ * slice_->slice_num_v_;
-        if (num_image == 0) return {};
-        
-        auto input_dims = trt_->static_dims(0);
-        int infer_batch_size = input_dims[0];
-        if (infer_batch_size != num_image) 
+        // coarse pass, the whole frame as a single slice letterboxed to the network input
+        current_plan_ = get_plan(image.width, image.height, image.width, image.height, 0.0f, 0.0f, false, true, stream);
+        if (current_plan_ == nullptr || current_plan_->slice_num() == 0) return {};
+        const ExecutionPlan &coarse_plan = *current_plan_;
+
+        slice_->slice(image, image.width, image.height, 1, 1, current_plan_->slice_start_point, stream);
+        active_slices_.assign(1, 0);
+        reused_slices_.clear();
+        carried_boxes_.clear();
+
+        // a failed pass leaves no candidates behind
+        adjust_memory(*current_plan_);
+        *box_count_.cpu() = 0;
+
+        float confidence_threshold = confidence_threshold_;
+        confidence_threshold_ = std::min(options.candidate_confidence, confidence_threshold);
+        forwards(stream);
+        confidence_threshold_ = confidence_threshold;
+
+        std::vector<slice::Candidate> candidates;
+        const float *parray = output_boxarray_.cpu();
+        int count = std::min(max_boxes_, *(box_count_.cpu()));
+        for (int i = 0; i < count; ++i)
         {
-            if (isdynamic_model_) 
-            {
-                infer_batch_size = num_image;
-                input_dims[0] = num_image;
-                if (!trt_->set_run_dims(0, input_dims)) 
-                {
-                    printf("Fail to set run dims\n");
-                    return {};
-                }
-            } 
-            else 
+            const float *pbox = parray + i * NUM_BOX_ELEMENT;
+            if (pbox[6] != 1) continue;
+
+            slice::Candidate candidate;
+            candidate.left       = pbox[0];
+            candidate.top        = pbox[1];
+            candidate.right      = pbox[2];
+            candidate.bottom     = pbox[3];
+            candidate.confidence = pbox[4];
+            candidates.push_back(candidate);
+            if (pbox[4] >= confidence_threshold) carried_boxes_.insert(carried_boxes_.end(), pbox, pbox + NUM_BOX_ELEMENT);
+        }
+
+        // fine pass, full resolution tiles around the uncertain and small candidates
+        int tile_width  = options.tile_width > 0 ? options.tile_width : network_input_width_;
+        int tile_height = options.tile_height > 0 ? options.tile_height : network_input_height_;
+        std::vector<int> points = slice::selectRefineTiles(candidates, image.width, image.height, tile_width, tile_height, options);
+        int num_tiles = (int)points.size() / 2;
+
+        stats_ = ForwardStats();
+        stats_.slices = 1 + num_tiles;
+
+        BoxArray result = forward_tiles(coarse_plan, points, tile_width, tile_height, stream);
+        carried_boxes_.clear();
+        return result;
+    }
+
+    // runs tiles of the frame sliced last at arbitrary start points, carried_boxes_ join their nms.
+    // the tiles change every frame so their plan is rebuilt in place, the roi is the one of source
+    BoxArray forward_tiles(const ExecutionPlan &source, const std::vector<int> &points, int tile_width, int tile_height, void *stream)
+    {
+        int num_tiles = (int)points.size() / 2;
+        if (tile_plan_ == nullptr) tile_plan_ = std::make_shared<ExecutionPlan>();
+        ExecutionPlan &plan = *tile_plan_;
+        plan.width        = source.width;
+        plan.height       = source.height;
+        plan.slice_width  = tile_width;
+        plan.slice_height = tile_height;
+        plan.slice_num_h  = num_tiles;
+        plan.slice_num_v  = 1;
+        plan.roi_cols     = source.roi_cols;
+        plan.roi_rows     = source.roi_rows;
+        plan.roi_cell     = source.roi_cell;
+        if (num_tiles > 0)
+        {
+            // the tiles drop boxes outside the roi like the source plan
+            if (plan.roi_cell > 0)
             {
-                if (infer_batch_size < num_image) 
-                {
-                    printf(
-                        "When using static shape model, number of images[%d] must be "
-                        "less than or equal to the maximum batch[%d].",
-                        num_image, infer_batch_size);
-                    return {};
-                }
+                checkRuntime(cudaMemcpyAsync(plan.roi_mask.gpu(source.roi_mask.gpu_size()), source.roi_mask.gpu(),
+                                            source.roi_mask.gpu_bytes(), cudaMemcpyDeviceToDevice, (cudaStream_t)stream));
             }
+            fill_plan(plan, points, {}, stream);
+            slice_->reslice(tile_width, tile_height, num_tiles, 1, plan.slice_start_point, stream);
+        }
+        else
+        {
+            plan.rounds.clear();
+            plan.run_dims.clear();
         }
-        adjust_memory(infer_batch_size);
 
-        affine::LetterBoxMatrix affine_matrix;
-        cudaStream_t stream_ = (cudaStream_t)stream;
-        for (int i = 0; i < num_image; ++i)
-            preprocess(i, affine_matrix, stream);
+        current_plan_ = tile_plan_;
+        active_slices_.resize(num_tiles);
+        for (int i = 0; i < num_tiles; ++i) active_slices_[i] = i;
+        reused_slices_.clear();
+        return forwards(stream);
+    }
 
-        float *bbox_output_device = bbox_predict_.gpu();
-        #ifdef TRT10
-        if (!trt_->forward(std::unordered_map<std::string, const void *>{
-                { "images", input_buffer_.gpu() }, 
-                { "output0", bbox_predict_.gpu() }
-            }, stream_))
+    // second pass over the children of the dense slices of the last grid pass, both levels go through one nms
+    BoxArray forward_dense(BoxArray result, void *stream)
+    {
+        if (result.empty()) return result;
+
+        std::shared_ptr<ExecutionPlan> grid_plan = current_plan_;
+        const ExecutionPlan &plan = *grid_plan;
+        int slice_num = plan.slice_num();
+        std::vector<std::vector<float>> box_sizes(slice_num);
+
+        carried_boxes_.clear();
+        const float *parray = output_boxarray_.cpu();
+        int count = std::min(max_boxes_, *(box_count_.cpu()));
+        for (int i = 0; i < count; ++i)
         {
-            printf("Failed to tensorRT forward.");
-            return {};
+            const float *pbox = parray + i * NUM_BOX_ELEMENT;
+            if (pbox[6] != 1) continue;
+
+            carried_boxes_.insert(carried_boxes_.end(), pbox, pbox + NUM_BOX_ELEMENT);
+            int islice = pbox[8];
+            if (islice < slice_num) box_sizes[islice].push_back(std::max(pbox[2] - pbox[0], pbox[3] - pbox[1]));
         }
-        #else
-        std::vector<void *> bindings{input_buffer_.gpu(), bbox_output_device};
-        if (!trt_->forward(bindings, stream)) 
+
+        int child_width, child_height;
+        std::vector<int> start_points(plan.slice_start_point.cpu(), plan.slice_start_point.cpu() + slice_num * 2);
+        std::vector<int> points = slice::subdivideDenseTiles(
+            start_points, plan.slice_width, plan.slice_height, plan.width, plan.height,
+            box_sizes, subdivision_, child_width, child_height);
+        if (!points.empty())
         {
-            printf("Failed to tensorRT forward.");
-            return {};
+            stats_.subdivided_slices = (int)points.size() / 2;
+            result = forward_tiles(plan, points, child_width, child_height, stream);
         }
-        #endif
+        carried_boxes_.clear();
+        return result;
+    }
 
-        int* box_count = box_count_.gpu();
-        checkRuntime(cudaMemsetAsync(box_count, 0, sizeof(int), stream_));
-        for (int ib = 0; ib < num_image; ++ib) 
-        {
-            int start_x = slice_->slice_start_point_.cpu()[ib*2];
-            int start_y = slice_->slice_start_point_.cpu()[ib*2+1];
-            // float *boxarray_device =
-            //     output_boxarray_.gpu() + ib * (MAX_IMAGE_BOXES * NUM_BOX_ELEMENT);
-            float *boxarray_device = output_boxarray_.gpu();
-            float *affine_matrix_device = affine_matrix_.gpu();
-            float *image_based_bbox_output =
-                bbox_output_device + ib * (bbox_head_dims_[1] * bbox_head_dims_[2]);
-            if (yolo_type_ == YoloType::YOLOV5)
+    virtual BoxArray forward_stream(slice::BandSource &source, int slice_width, int slice_height, float overlap_width_ratio, float overlap_height_ratio, void *stream = nullptr) override
+    {
+        int width  = source.width();
+        int height = source.height();
+        if (width <= 0 || height <= 0) return {};
+
+        if (slice_width <= 0 || slice_height <= 0)
+        {
+            slice::SliceGrid grid = planner_.plan(width, height);
+            slice_width  = grid.slice_width;
+            slice_height = grid.slice_height;
+            overlap_width_ratio  = grid.overlap_width_ratio;
+            overlap_height_ratio = grid.overlap_height_ratio;
+        }
+
+        // one band per row of slices, every band is a small frame whose plan has a single row of the same slices
+        int slice_num_h, slice_num_v;
+        std::vector<int> points = slice::calculateSliceStartPoints(
+            width, height, slice_width, slice_height,
+            overlap_width_ratio, overlap_height_ratio, slice_num_h, slice_num_v, shift_edges_);
+
+        int band_height = std::min(slice_height, height);
+        size_t line_size = (size_t)width * 3;
+        const uint8_t *previous = nullptr;
+        int band_y = 0, band_rows = 0;
+
+        BoxArray boxes;
+        ForwardStats total;
+        for (int j = 0; j < slice_num_v; ++j)
+        {
+            int y = points[j * 2 + 1];
+            int rows = std::min(band_height, height - y);
+
+            // the band is read straight into the pinned memory of the next upload, the rows shared with
+            // the previous band are copied over from its slot of the ring, only the new ones are read
+            uint8_t *band = slice_->staging_buffer(width, rows);
+            int keep = 0;
+            if (band_rows > 0 && y < band_y + band_rows)
             {
-                decode_kernel_invoker_v5(image_based_bbox_output, bbox_head_dims_[1], num_classes_,
-                                    bbox_head_dims_[2], confidence_threshold_, nms_threshold_,
-                                    affine_matrix_device, boxarray_device, box_count, MAX_IMAGE_BOXES, start_x, start_y, stream_);
+                keep = band_y + band_rows - y;
+                memcpy(band, previous + (y - band_y) * line_size, keep * line_size);
             }
-            else if (yolo_type_ == YoloType::YOLOV8 || yolo_type_ == YoloType::YOLOV11)
+            if (!source.read(y + keep, rows - keep, band + keep * line_size))
             {
-                decode_kernel_invoker_v8(image_based_bbox_output, bbox_head_dims_[1], num_classes_,
-                                    bbox_head_dims_[2], confidence_threshold_, nms_threshold_,
-                                    affine_matrix_device, boxarray_device, box_count, MAX_IMAGE_BOXES, start_x, start_y, stream_);
+                printf("Failed to read rows %d to %d\n", y + keep, y + rows);
+                return {};
             }
-            
+            previous  = band;
+            band_y    = y;
+            band_rows = rows;
+
+            // the roi and the full frame item are defined on whole frames, bands ignore them
+            tensor::Image image(band, width, rows);
+            current_plan_ = get_plan(width, rows, slice_width, slice_height, overlap_width_ratio, overlap_height_ratio, false, false, stream);
+            for (auto &box : forward_plan(image, false, stream))
+            {
+                box.top    += y;
+                box.bottom += y;
+                boxes.emplace_back(box);
+            }
+
+            total.slices            += stats_.slices;
+            total.skipped_slices    += stats_.skipped_slices;
+            total.subdivided_slices += stats_.subdivided_slices;
         }
-        float *boxarray_device =  output_boxarray_.gpu();
-        fast_nms_kernel_invoker(boxarray_device, box_count, MAX_IMAGE_BOXES, nms_threshold_, stream_);
-        checkRuntime(cudaMemcpyAsync(output_boxarray_.cpu(), output_boxarray_.gpu(),
-                                    output_boxarray_.gpu_bytes(), cudaMemcpyDeviceToHost, stream_));
-        checkRuntime(cudaMemcpyAsync(box_count_.cpu(), box_count_.gpu(),
-                                    box_count_.gpu_bytes(), cudaMemcpyDeviceToHost, stream_));
-        checkRuntime(cudaStreamSynchronize(stream_));
+        stats_ = total;
 
-        BoxArray result;
-        // int imemory = 0;
-        float *parray = output_boxarray_.cpu();
-        int count = min(MAX_IMAGE_BOXES, *(box_count_.cpu()));
-        for (int i = 0; i < count; ++i) 
-        {
-            float *pbox = parray + i * NUM_BOX_ELEMENT;
-            int label = pbox[5];
-            int keepflag = pbox[6];
-            if (keepflag == 1) {
-                Box result_object_box(pbox[0], pbox[1], pbox[2], pbox[3], pbox[4], label);
-                result.emplace_back(result_object_box);
+        // every band was suppressed on its own, boxes split by a band boundary meet here
+        int count = (int)boxes.size();
+        std::vector<float> rows((size_t)count * NUM_BOX_ELEMENT, 0.0f);
+        for (int i = 0; i < count; ++i)
+        {
+            float *pbox = rows.data() + (size_t)i * NUM_BOX_ELEMENT;
+            pbox[0] = boxes[i].left;
+            pbox[1] = boxes[i].top;
+            pbox[2] = boxes[i].right;
+            pbox[3] = boxes[i].bottom;
+            pbox[4] = boxes[i].confidence;
+            pbox[5] = boxes[i].class_label;
+        }
+        nms::nms_rows_host(rows.data(), count, NUM_BOX_ELEMENT, nms_threshold_);
+        return parse_boxes(rows.data(), count);
+    }
+
+    virtual BoxArray forward(const tensor::Image &image, void *stream = nullptr) override 
+    {
+        return forward(image, 0, 0, 0.0f, 0.0f, stream);
+    }
+
+    virtual std::shared_future<BoxArray> forward_async(const tensor::Image &image, void *stream = nullptr) override
+    {
+        return forward_async(image, 0, 0, 0.0f, 0.0f, stream);
+    }
+
+    virtual std::shared_future<BoxArray> forward_async(const tensor::Image &image, int slice_width, int slice_height, float overlap_width_ratio, float overlap_height_ratio, void *stream = nullptr) override
+    {
+        std::promise<BoxArray> promise;
+        if (motion_gate_.enabled || subdivision_.enabled || slice_->backend_ == slice::SliceBackend::Host)
+        {
+            promise.set_value(forward(image, slice_width, slice_height, overlap_width_ratio, overlap_height_ratio, stream));
+            return promise.get_future().share();
+        }
+
+        // the oldest request holds the buffers of this one until its boxes are parsed
+        AsyncRequest &request = requests_[next_request_];
+        next_request_ = (next_request_ + 1) % MAX_ASYNC_REQUESTS;
+        if (request.result.valid()) request.result.wait();
+        request.result = promise.get_future().share();
+        request.max_boxes = max_boxes_;
+
+        current_plan_ = get_plan(image.width, image.height, slice_width, slice_height, overlap_width_ratio, overlap_height_ratio, full_frame_, true, stream);
+        request.plan  = current_plan_;
+        if (!slice_plan(image, false, stream) ||
+            !enqueue(request.slices, request.tiles, request.cores, request.boxarray, request.box_count, stream))
+        {
+            promise.set_value(BoxArray());
+            return request.result;
+        }
+
+        if (request.done == nullptr) checkRuntime(cudaEventCreateWithFlags(&request.done, cudaEventDisableTiming));
+        checkRuntime(cudaEventRecord(request.done, (cudaStream_t)stream));
+        if (!completion_.joinable())
+        {
+            int device = 0;
+            checkRuntime(cudaGetDevice(&device));
+            completion_ = std::thread(&YoloModelImpl::complete_requests, this, device);
+        }
+        {
+            std::lock_guard<std::mutex> lock(completion_lock_);
+            completion_queue_.emplace_back(&request, std::move(promise));
+        }
+        completion_cv_.notify_one();
+        return request.result;
+    }
+
+    // completion thread of forward_async, waits for the requests in order and parses their boxes
+    void complete_requests(int device)
+    {
+        checkRuntime(cudaSetDevice(device));
+        for (;;)
+        {
+            std::pair<AsyncRequest *, std::promise<BoxArray>> item;
+            {
+                std::unique_lock<std::mutex> lock(completion_lock_);
+                completion_cv_.wait(lock, [this] { return completion_stop_ || !completion_queue_.empty(); });
+                if (completion_queue_.empty()) return;
+                item = std::move(completion_queue_.front());
+                completion_queue_.pop_front();
             }
+
+            AsyncRequest *request = item.first;
+            checkRuntime(cudaEventSynchronize(request->done));
+            int count = std::min(request->max_boxes, *(request->box_count.cpu()));
+            item.second.set_value(parse_boxes(request->boxarray.cpu(), count));
         }
-        return result;
+    }
+
+    // device cores of the decode ownership filter for the slices of this frame, nullptr without ownership.
+    // the cores of the plan assume every slice is inferred, slices next to a skipped one are widened towards it
+    const float *frame_cores(const ExecutionPlan &plan, tensor::Memory<float> &cores_host, void *stream)
+    {
+        if (!tile_ownership_ || !plan.has_core) return nullptr;
+
+        int slice_num = plan.slice_num();
+        std::vector<uint8_t> seen(slice_num, 0);
+        for (int islice : active_slices_) if (islice < slice_num) seen[islice] = 1;
+        for (int islice : reused_slices_) if (islice < slice_num) seen[islice] = 1;
+        if (std::count(seen.begin(), seen.end(), 1) == slice_num) return plan.slice_core.gpu();
+
+        int num_core = plan.image_num() * slice::NUM_CORE_ELEMENT;
+        std::vector<float> cores(plan.slice_core.cpu(), plan.slice_core.cpu() + num_core);
+        std::vector<int> points(plan.slice_start_point.cpu(), plan.slice_start_point.cpu() + slice_num * 2);
+        cores = slice::widenCores(cores, points, plan.slice_width, plan.slice_height, seen);
+
+        // the device copy is ordered by the stream behind the decode of the previous frame, the host copy is the caller's
+        memcpy(cores_host.cpu(num_core), cores.data(), num_core * sizeof(float));
+        float *cores_device = active_cores_.gpu(num_core);
+        checkRuntime(cudaMemcpyAsync(cores_device, cores_host.cpu(), num_core * sizeof(float), cudaMemcpyHostToDevice,
+                                    (cudaStream_t)stream));
+        return cores_device;
+    }
+
+    // decodes the engine output of num_round items into output_boxarray_ after the boxes of the earlier rounds.
+    // slices_device holds the slice index of every item, cores_device the cores of the frame or nullptr
+    void decode_round(const ExecutionPlan &plan, const int *slices_device, const float *cores_device, int num_round,
+                      cudaStream_t stream)
+    {
+        // one decode launch for the whole round, every item finds its matrix through its slice index
+        float *bbox_output_device = bbox_predict_.gpu();
+        int* box_count = box_count_.gpu();
+        const uint8_t *roi = plan.roi_cell > 0 ? plan.roi_mask.gpu() : nullptr;
+        const float *cores = cores_device;
+        if (yolo_type_ == YoloType::YOLOV5)
+        {
+            decode_kernel_invoker_v5(bbox_output_device, bbox_head_dims_[1], num_classes_, bbox_head_dims_[2],
+                                plan.output_numel, num_round, confidence_threshold_,
+                                slices_device, plan.affine_matrix.gpu(), plan.slice_start_point.gpu(), cores,
+                                output_boxarray_.gpu(), box_count, max_boxes_,
+                                roi, plan.roi_cols, plan.roi_rows, plan.roi_cell, stream);
+        }
+        else if (yolo_type_ == YoloType::YOLOV8 || yolo_type_ == YoloType::YOLOV11)
+        {
+            decode_kernel_invoker_v8(bbox_output_device, bbox_head_dims_[1], num_classes_, bbox_head_dims_[2],
+                                plan.output_numel, num_round, confidence_threshold_,
+                                slices_device, plan.affine_matrix.gpu(), plan.slice_start_point.gpu(), cores,
+                                output_boxarray_.gpu(), box_count, max_boxes_,
+                                roi, plan.roi_cols, plan.roi_rows, plan.roi_cell, stream);
+        }
+    }
+
+    virtual BoxArray forwards(void *stream = nullptr) override 
+    {
+        if (!enqueue(batch_slices_, batch_tiles_, active_cores_, output_boxarray_, box_count_, stream)) return {};
+        checkRuntime(cudaStreamSynchronize((cudaStream_t)stream));
+
+        float *parray = output_boxarray_.cpu();
+        int count = std::min(max_boxes_, *(box_count_.cpu()));
+        if (motion_gate_.enabled && gated_plan_ == current_plan_) update_slice_boxes(parray, count);
+        return parse_boxes(parray, count);
+    }
+
+    // queues the rounds of the active slices, the nms and the download of the boxes without waiting for them.
+    // the cpu() of slices and tiles are the pinned sources of the uploads, the boxes land in the cpu() of
+    // boxarray and box_count. false when there is nothing to run
+    bool enqueue(tensor::Memory<int> &slices_host, tensor::Memory<affine::WarpTile> &tiles_host,
+                 tensor::Memory<float> &cores_host, tensor::Memory<float> &boxarray_host, tensor::Memory<int> &count_host, void *stream)
+    {
+        if (current_plan_ == nullptr) return false;
+        ExecutionPlan &plan = *current_plan_;
+        const int *slices = active_slices_.data();
+        int num_image = (int)active_slices_.size();
+        if (num_image == 0 && reused_slices_.empty() && carried_boxes_.empty()) return false;
+
+        adjust_memory(plan);
+
+        cudaStream_t stream_ = (cudaStream_t)stream;
+        int* box_count = box_count_.gpu();
+        if (reused_slices_.empty() && carried_boxes_.empty())
+            checkRuntime(cudaMemsetAsync(box_count, 0, sizeof(int), stream_));
+        else
+            upload_reused_boxes(stream);
+
+        // slice index and warp tile of every batch item, uploaded once for all rounds. without skipped slices the
+        // batch is the whole plan and both arrays are already on the device
+        bool full = num_image == plan.image_num();
+        const int *slices_device = nullptr;
+        const affine::WarpTile *tiles_device = nullptr;
+        if (full && num_image > 0)
+        {
+            slices_device = plan.all_slices.gpu();
+            tiles_device  = plan_tiles(plan, stream);
+        }
+        else if (num_image > 0)
+        {
+            memcpy(slices_host.cpu(num_image), slices, num_image * sizeof(int));
+            slices_device = batch_slices_.gpu(num_image);
+            checkRuntime(cudaMemcpyAsync(batch_slices_.gpu(), slices_host.cpu(), num_image * sizeof(int), cudaMemcpyHostToDevice, stream_));
+
+            affine::WarpTile *tiles = tiles_host.cpu(num_image);
+            for (int i = 0; i < num_image; ++i) tiles[i] = warp_tile(plan, slices[i]);
+            tiles_device = batch_tiles_.gpu(num_image);
+            checkRuntime(cudaMemcpyAsync(batch_tiles_.gpu(), tiles, num_image * sizeof(affine::WarpTile), cudaMemcpyHostToDevice, stream_));
+        }
+
+        const float *cores_device = frame_cores(plan, cores_host, stream);
+
+        // the rounds of the plan only hold when no slice was skipped
+        std::vector<std::tuple<int, int>> compact_rounds;
+        std::vector<std::vector<int>> compact_dims;
+        if (!full)
+        {
+            compact_rounds = split_rounds(num_image, max_batch_size_);
+            for (auto &round : compact_rounds) compact_dims.emplace_back(round_dims(*trt_, std::get<1>(round)));
+        }
+
+        // more tiles than the engine accepts are run in several rounds sharing the same buffers,
+        // all rounds decode into output_boxarray_ and a single nms is done at the end
+        bool ok = run_rounds(*trt_, full ? plan.rounds : compact_rounds, full ? plan.run_dims : compact_dims,
+            input_buffer_.gpu(), bbox_predict_.gpu(),
+            [&](int ibegin, int num_round) {
+                warp_.batch(tiles_device + ibegin, num_round, input_buffer_.gpu(), network_input_width_, network_input_height_,
+                            114, normalize_, stream_);
+                return true;
+            },
+            [&](int ibegin, int num_round) {
+                decode_round(plan, slices_device + ibegin, cores_device, num_round, stream_);
+                return true;
+            },
+            stream);
+        if (!ok) return false;
+
+        float *boxarray_device =  output_boxarray_.gpu();
+        nms::nms_rows(boxarray_device, box_count, max_boxes_, NUM_BOX_ELEMENT, nms_threshold_, nms_workspace_, stream_);
+        checkRuntime(cudaMemcpyAsync(boxarray_host.cpu(max_boxes_ * NUM_BOX_ELEMENT), output_boxarray_.gpu(),
+                                    max_boxes_ * NUM_BOX_ELEMENT * sizeof(float), cudaMemcpyDeviceToHost, stream_));
+        checkRuntime(cudaMemcpyAsync(count_host.cpu(1), box_count_.gpu(),
+                                    box_count_.gpu_bytes(), cudaMemcpyDeviceToHost, stream_));
+        return true;
     }
 
 };
 
 
-Infer *loadraw(const std::string &engine_file, YoloType yolo_type, float confidence_threshold,
+Infer *loadraw(std::shared_ptr<TensorRT::Engine> engine, YoloType yolo_type, float confidence_threshold,
                float nms_threshold) 
 {
     YoloModelImpl *impl = new YoloModelImpl();
-    if (!impl->load(engine_file, yolo_type, confidence_threshold, nms_threshold)) 
+    if (!impl->load(engine, yolo_type, confidence_threshold, nms_threshold)) 
     {
         delete impl;
-        impl = nullptr;
+        return nullptr;
     }
     impl->slice_ = std::make_shared<slice::SliceImage>();
+    impl->slice_->mode_ = slice::SliceMode::View;
     return impl;
 }
 
 std::shared_ptr<Infer> load(const std::string &engine_file, YoloType yolo_type, int gpu_id, float confidence_threshold, float nms_threshold) 
 {
     checkRuntime(cudaSetDevice(gpu_id));
-    return std::shared_ptr<YoloModelImpl>((YoloModelImpl *)loadraw(engine_file, yolo_type, confidence_threshold, nms_threshold));
+    return std::shared_ptr<YoloModelImpl>((YoloModelImpl *)loadraw(TensorRT::load(engine_file), yolo_type, confidence_threshold, nms_threshold));
+}
+
+std::shared_ptr<Infer> load(std::shared_ptr<TensorRT::Engine> engine, YoloType yolo_type, int gpu_id, float confidence_threshold, float nms_threshold) 
+{
+    checkRuntime(cudaSetDevice(gpu_id));
+    return std::shared_ptr<YoloModelImpl>((YoloModelImpl *)loadraw(engine, yolo_type, confidence_threshold, nms_threshold));
 }
 
 }
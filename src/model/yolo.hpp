@@ -1,8 +1,12 @@
 #ifndef YOLOV11_HPP__
 #define YOLOV11_HPP__
 #include <vector>
+#include <future>
 #include "common/memory.hpp"
 #include "common/image.hpp"
+#include "slice/slice.hpp"
+#include "slice/stream.hpp"
+#include "model/rounds.hpp"
 #include <iomanip>
 
 namespace yolo
@@ -43,16 +47,96 @@ enum class YoloType : int{
 
 using BoxArray = std::vector<Box>;
 
+// forward_async requests in flight, a further request waits for the oldest one.
+// every request holds a slot of the upload ring until its work has run
+static const int MAX_ASYNC_REQUESTS = slice::NUM_FRAME_SLOTS;
+
+// what the last forward did
+struct ForwardStats
+{
+    int slices = 0;             // slices of the grid
+    int skipped_slices = 0;     // slices dropped by the slice filter
+    int reused_slices = 0;      // unchanged slices whose previous candidates were reused
+    int subdivided_slices = 0;  // finer tiles inferred in the second pass over dense slices
+};
+
 
 class Infer {
 public:
     virtual BoxArray forward(const tensor::Image &image, int slice_width, int slice_height, float overlap_width_ratio, float overlap_height_ratio, void *stream = nullptr) = 0;
     virtual BoxArray forward(const tensor::Image &image, void *stream = nullptr) = 0;
     virtual BoxArray forwards(void *stream = nullptr) = 0;
+
+    // queues the frame and returns without waiting for the gpu, the boxes are parsed by a completion thread.
+    // the frame may be reused as soon as the call returns, up to MAX_ASYNC_REQUESTS requests stay in flight and
+    // all of them must use the same stream. motion gate, subdivision and the host backend need the boxes of a
+    // frame before the next one and fall back to forward. with a slice filter the cuda backend waits for the
+    // statistics of the frame, and with them for the requests queued before it on the stream
+    virtual std::shared_future<BoxArray> forward_async(const tensor::Image &image, void *stream = nullptr) = 0;
+    virtual std::shared_future<BoxArray> forward_async(const tensor::Image &image, int slice_width, int slice_height, float overlap_width_ratio, float overlap_height_ratio, void *stream = nullptr) = 0;
+
+    // SliceMode::Materialize copies every slice into its own buffer before preprocess (debugging),
+    // the default SliceMode::View reads the slices in place from the uploaded image
+    virtual void set_slice_mode(slice::SliceMode mode) = 0;
+
+    // SliceBackend::Host crops on the cpu, e.g. when the gpu is saturated
+    virtual void set_slice_backend(slice::SliceBackend backend) = 0;
+
+    // frames are copied to pinned memory and uploaded on a copy stream, ordered with events (default).
+    // false uploads from the caller's memory on the inference stream
+    virtual void set_pinned_staging(bool enable) = 0;
+
+    // pinned bgr frame of the next forward, a decoder writing into it saves the copy to the pinned memory.
+    // only valid until that forward
+    virtual tensor::Image staging_image(int width, int height) = 0;
+
+    // drop slices without content before inference, stats() reports how many were skipped
+    virtual void set_slice_filter(const slice::SliceFilter &filter) = 0;
+    virtual ForwardStats stats() = 0;
+
+    // coarse to fine, a downscaled pass over the whole frame and then full resolution tiles
+    // only around its low confidence or small candidates, both merged in one nms
+    virtual BoxArray forward_refine(const tensor::Image &image, const slice::RefineOptions &options, void *stream = nullptr) = 0;
+
+    // images too large for memory, read band by band from source and sliced with a row of slices per band.
+    // bands are read into the pinned upload ring, host and device memory stay at a few bands.
+    // slice_width == 0 chooses the slices with the planner
+    virtual BoxArray forward_stream(slice::BandSource &source, int slice_width, int slice_height, float overlap_width_ratio, float overlap_height_ratio, void *stream = nullptr) = 0;
+
+    // slices of forward whose detections are numerous or small are split into finer tiles and inferred again
+    virtual void set_subdivision(const slice::SubdivisionPolicy &policy) = 0;
+
+    // true (default) shifts the last slice of a row or column back inside the frame over already covered pixels,
+    // false keeps the regular step and infers the smaller cropped slice with its own matrix
+    virtual void set_shift_edges(bool enable) = 0;
+
+    // a box is kept only by the slice whose core (its share of the overlaps) holds the box centre,
+    // most duplicates of the overlaps never reach nms. the full frame item and second pass tiles keep everything
+    virtual void set_tile_ownership(bool enable) = 0;
+
+    // only slices touching the roi are inferred and boxes centred outside it are dropped, an empty roi is the whole frame
+    virtual void set_roi(const slice::Roi &roi) = 0;
+
+    // decoded boxes kept per frame before nms (4096 by default), further boxes of crowded frames are dropped.
+    // the box buffers and the nms workspace grow with it, the cost of nms grows with its square
+    virtual void set_max_boxes(int max_boxes) = 0;
+
+    // also infer the letterboxed full frame in the same batch as the slices, like the standard prediction of sahi
+    virtual void set_full_frame(bool enable) = 0;
+
+    // video mode for static cameras, only slices that changed since the previous frame are inferred again
+    virtual void set_motion_gate(const slice::MotionGate &gate) = 0;
+
+    // build and cache the execution plan of a frame geometry ahead of time, e.g. at startup
+    virtual bool prepare(int width, int height, int slice_width, int slice_height, float overlap_width_ratio, float overlap_height_ratio, void *stream = nullptr) = 0;
+    virtual bool prepare(int width, int height, void *stream = nullptr) = 0;
 };
 
 std::shared_ptr<Infer> load(const std::string &engine_file, YoloType yolo_type, int gpu_id = 0, float confidence_threshold=0.5f, float nms_threshold=0.45f);
 
+// an engine that is already deserialized, or any other TensorRT::Engine such as a wrapper around one
+std::shared_ptr<Infer> load(std::shared_ptr<TensorRT::Engine> engine, YoloType yolo_type, int gpu_id = 0, float confidence_threshold=0.5f, float nms_threshold=0.45f);
+
 }
 
 
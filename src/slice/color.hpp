@@ -0,0 +1,89 @@
+#ifndef COLOR_HPP__
+#define COLOR_HPP__
+
+#include "common/image.hpp"
+#include <cstddef>
+#include <cstdint>
+
+// the per pixel conversion is shared by the cuda kernel and the host converter
+#ifdef __CUDACC__
+#define COLOR_HOST_DEVICE __host__ __device__
+#else
+#define COLOR_HOST_DEVICE
+#endif
+
+namespace slice
+{
+
+// bt.601 video range yuv to bgr with the fixed point coefficients of opencv's cvtColor (COLOR_YUV2BGR_NV12),
+// integer math so the host and the device give the same bytes
+inline COLOR_HOST_DEVICE uint8_t saturate_color(int value) { return value < 0 ? 0 : (value > 255 ? 255 : value); }
+
+inline COLOR_HOST_DEVICE void yuv_to_bgr(int y, int u, int v, uint8_t *bgr)
+{
+    const int CY = 1220542, CUB = 2116026, CUG = -409993, CVG = -852492, CVR = 1673527, SHIFT = 20;
+    u -= 128;
+    v -= 128;
+    int ruv = (1 << (SHIFT - 1)) + CVR * v;
+    int guv = (1 << (SHIFT - 1)) + CVG * v + CUG * u;
+    int buv = (1 << (SHIFT - 1)) + CUB * u;
+    int yy = (y > 16 ? y - 16 : 0) * CY;
+    bgr[0] = saturate_color((yy + buv) >> SHIFT);
+    bgr[1] = saturate_color((yy + guv) >> SHIFT);
+    bgr[2] = saturate_color((yy + ruv) >> SHIFT);
+}
+
+// pixel (x, y) of image as bgr. every stride of image must be set, see tensor::Image::line_size
+inline COLOR_HOST_DEVICE void load_bgr(const tensor::Image &image, int x, int y, uint8_t *bgr)
+{
+    const uint8_t *plane0 = (const uint8_t *)image.planes[0] + (size_t)y * image.strides[0];
+    switch (image.format)
+    {
+    case tensor::PixelFormat::BGR:
+        bgr[0] = plane0[x * 3];
+        bgr[1] = plane0[x * 3 + 1];
+        bgr[2] = plane0[x * 3 + 2];
+        break;
+    case tensor::PixelFormat::RGB:
+        bgr[0] = plane0[x * 3 + 2];
+        bgr[1] = plane0[x * 3 + 1];
+        bgr[2] = plane0[x * 3];
+        break;
+    case tensor::PixelFormat::BGRA:
+        bgr[0] = plane0[x * 4];
+        bgr[1] = plane0[x * 4 + 1];
+        bgr[2] = plane0[x * 4 + 2];
+        break;
+    case tensor::PixelFormat::GRAY:
+        bgr[0] = bgr[1] = bgr[2] = plane0[x];
+        break;
+    case tensor::PixelFormat::NV12:
+    {
+        const uint8_t *uv = (const uint8_t *)image.planes[1] + (size_t)(y / 2) * image.strides[1] + (x / 2) * 2;
+        yuv_to_bgr(plane0[x], uv[0], uv[1], bgr);
+        break;
+    }
+    case tensor::PixelFormat::I420:
+    {
+        const uint8_t *u = (const uint8_t *)image.planes[1] + (size_t)(y / 2) * image.strides[1] + x / 2;
+        const uint8_t *v = (const uint8_t *)image.planes[2] + (size_t)(y / 2) * image.strides[2] + x / 2;
+        yuv_to_bgr(plane0[x], *u, *v, bgr);
+        break;
+    }
+    }
+}
+
+// image with every stride resolved, plane pointers unchanged
+inline tensor::Image resolve_strides(const tensor::Image &image)
+{
+    tensor::Image resolved = image;
+    for (int i = 0; i < image.num_planes(); ++i) resolved.strides[i] = image.line_size(i);
+    return resolved;
+}
+
+// host reference of the conversion done while slicing, bgr is width x height x 3 packed
+void convert_to_bgr_host(const tensor::Image &image, uint8_t *bgr);
+
+}
+
+#endif
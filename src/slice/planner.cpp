@@ -0,0 +1,385 @@
+#include "slice/planner.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+
+namespace slice
+{
+
+int overlapPixels(int subDimension, float overlapRatio)
+{
+    return static_cast<int>(subDimension * overlapRatio);
+}
+
+int calculateNumCuts(int dimension, int subDimension, float overlapRatio)
+{
+    // 与 SliceImage::slice 使用同样的整数步长，避免浮点误差多切一张图
+    int step = subDimension - overlapPixels(subDimension, overlapRatio);
+    if (dimension <= subDimension || step <= 0)
+    {
+        return 1;
+    }
+    return (dimension - subDimension + step - 1) / step + 1;
+}
+
+std::vector<int> calculateSliceStartPoints(
+    int width, int height, int slice_width, int slice_height,
+    float overlap_width_ratio, float overlap_height_ratio,
+    int &slice_num_h, int &slice_num_v, bool shift_edges)
+{
+    slice_num_h = calculateNumCuts(width, slice_width, overlap_width_ratio);
+    slice_num_v = calculateNumCuts(height, slice_height, overlap_height_ratio);
+    int overlap_width_pixel  = overlapPixels(slice_width, overlap_width_ratio);
+    int overlap_height_pixel = overlapPixels(slice_height, overlap_height_ratio);
+
+    std::vector<int> points(slice_num_h * slice_num_v * 2);
+    for (int i = 0; i < slice_num_h; i++)
+    {
+        // a slice larger than the image starts at 0 and is padded on the right and bottom
+        int x = i * (slice_width - overlap_width_pixel);
+        if (shift_edges) x = std::max(0, std::min(width - slice_width, x));
+        for (int j = 0; j < slice_num_v; j++)
+        {
+            int y = j * (slice_height - overlap_height_pixel);
+            if (shift_edges) y = std::max(0, std::min(height - slice_height, y));
+            int index = (i * slice_num_v + j) * 2;
+            points[index]     = x;
+            points[index + 1] = y;
+        }
+    }
+    return points;
+}
+
+std::vector<int> calculateSliceSizes(
+    const std::vector<int>& slice_start_point, int width, int height, int slice_width, int slice_height)
+{
+    std::vector<int> sizes(slice_start_point.size());
+    for (size_t i = 0; i < slice_start_point.size(); i += 2)
+    {
+        sizes[i]     = std::max(1, std::min(slice_width, width - slice_start_point[i]));
+        sizes[i + 1] = std::max(1, std::min(slice_height, height - slice_start_point[i + 1]));
+    }
+    return sizes;
+}
+
+std::vector<float> calculateSliceCores(
+    const std::vector<int>& slice_start_point, int slice_num_h, int slice_num_v,
+    int slice_width, int slice_height)
+{
+    const float inf = std::numeric_limits<float>::infinity();
+    std::vector<float> cores(slice_num_h * slice_num_v * NUM_CORE_ELEMENT);
+    auto x = [&](int i) { return (float)slice_start_point[i * slice_num_v * 2]; };
+    auto y = [&](int j) { return (float)slice_start_point[j * 2 + 1]; };
+
+    for (int i = 0; i < slice_num_h; ++i)
+    {
+        float left  = i == 0 ? -inf : (x(i - 1) + slice_width + x(i)) * 0.5f;
+        float right = i == slice_num_h - 1 ? inf : (x(i) + slice_width + x(i + 1)) * 0.5f;
+        for (int j = 0; j < slice_num_v; ++j)
+        {
+            float* core = cores.data() + (i * slice_num_v + j) * NUM_CORE_ELEMENT;
+            core[0] = left;
+            core[1] = j == 0 ? -inf : (y(j - 1) + slice_height + y(j)) * 0.5f;
+            core[2] = right;
+            core[3] = j == slice_num_v - 1 ? inf : (y(j) + slice_height + y(j + 1)) * 0.5f;
+        }
+    }
+    return cores;
+}
+
+std::vector<float> widenCores(
+    const std::vector<float>& cores, const std::vector<int>& slice_start_point,
+    int slice_width, int slice_height, const std::vector<uint8_t>& seen)
+{
+    const float inf = std::numeric_limits<float>::infinity();
+    std::vector<float> widened = cores;
+    int slice_num = (int)seen.size();
+    for (int i = 0; i < slice_num; ++i)
+    {
+        if (!seen[i]) continue;
+        int x = slice_start_point[i * 2], y = slice_start_point[i * 2 + 1];
+        float* core = widened.data() + i * NUM_CORE_ELEMENT;
+        for (int j = 0; j < slice_num; ++j)
+        {
+            if (seen[j]) continue;
+            int other_x = slice_start_point[j * 2], other_y = slice_start_point[j * 2 + 1];
+            if (std::abs(other_x - x) >= slice_width || std::abs(other_y - y) >= slice_height) continue;
+
+            if (other_x < x) core[0] = -inf;
+            if (other_y < y) core[1] = -inf;
+            if (other_x > x) core[2] = inf;
+            if (other_y > y) core[3] = inf;
+        }
+    }
+    return widened;
+}
+
+static int ceil_div(int a, int b) { return (a + b - 1) / b; }
+
+// smallest overlap in pixels that satisfies the ratio, always leaves a positive step
+static int min_overlap_pixels(int tile, float ratio)
+{
+    int overlap = static_cast<int>(std::ceil(static_cast<double>(ratio) * tile - 1e-6));
+    return std::min(std::max(overlap, 0), tile - 1);
+}
+
+static bool covers(int dimension, int tile, int num, float ratio)
+{
+    int step = tile - min_overlap_pixels(tile, ratio);
+    return tile + static_cast<long long>(num - 1) * step >= dimension;
+}
+
+// returns {tile size, overlap pixel, number of tiles} along one axis
+static std::tuple<int, int, int> plan_axis(int dimension, int network, float overlap_ratio, float scale_ratio)
+{
+    int max_tile = dimension;
+    if (scale_ratio > 0)
+        max_tile = static_cast<int>(std::floor(network / static_cast<double>(scale_ratio) + 1e-6));
+    max_tile = std::max(1, std::min(max_tile, dimension));
+
+    if (max_tile >= dimension)
+        return std::make_tuple(dimension, 0, 1);
+
+    int step = max_tile - min_overlap_pixels(max_tile, overlap_ratio);
+    int num = ceil_div(dimension - max_tile, step) + 1;
+
+    // same number of tiles, but the smallest tile that still covers the axis
+    int tile = std::max(ceil_div(dimension, num), 1);
+    while (tile < max_tile && !covers(dimension, tile, num, overlap_ratio)) ++tile;
+    return std::make_tuple(tile, min_overlap_pixels(tile, overlap_ratio), num);
+}
+
+SliceGrid SlicePlanner::plan(int width, int height) const
+{
+    SliceGrid grid;
+    if (width <= 0 || height <= 0 || network_width <= 0 || network_height <= 0) return grid;
+
+    float overlap_ratio = std::min(std::max(min_overlap_ratio, 0.0f), 0.9f);
+    std::tie(grid.slice_width, grid.overlap_width_pixel, grid.slice_num_h) =
+        plan_axis(width, network_width, overlap_ratio, min_scale_ratio);
+    std::tie(grid.slice_height, grid.overlap_height_pixel, grid.slice_num_v) =
+        plan_axis(height, network_height, overlap_ratio, min_scale_ratio);
+
+    // overlapPixels truncates, so shift the ratio by half a pixel to land exactly on the planned overlap
+    grid.overlap_width_ratio  = (grid.overlap_width_pixel + 0.5f) / grid.slice_width;
+    grid.overlap_height_ratio = (grid.overlap_height_pixel + 0.5f) / grid.slice_height;
+
+    int batch = std::max(max_batch, 1);
+    grid.rounds = ceil_div(grid.slice_num(), batch);
+    return grid;
+}
+
+bool isDenseTile(const SubdivisionPolicy& policy, std::vector<float> box_sizes)
+{
+    if (box_sizes.empty()) return false;
+    if (policy.min_boxes > 0 && (int)box_sizes.size() >= policy.min_boxes) return true;
+
+    auto middle = box_sizes.begin() + box_sizes.size() / 2;
+    std::nth_element(box_sizes.begin(), middle, box_sizes.end());
+    return *middle < policy.min_median_size;
+}
+
+int childTileSize(int tile, int splits, float overlapRatio)
+{
+    if (splits <= 1 || tile <= 1) return tile;
+
+    int child = ceil_div(tile, splits);
+    while (child < tile && calculateNumCuts(tile, child, overlapRatio) > splits) ++child;
+    return child;
+}
+
+std::vector<int> subdivideDenseTiles(
+    const std::vector<int>& start_points, int tile_width, int tile_height, int width, int height,
+    const std::vector<std::vector<float>>& box_sizes, const SubdivisionPolicy& policy,
+    int& child_width, int& child_height)
+{
+    std::vector<int> children;
+    child_width  = std::min(tile_width, std::max(childTileSize(tile_width, policy.splits, policy.overlap_ratio), policy.min_tile_size));
+    child_height = std::min(tile_height, std::max(childTileSize(tile_height, policy.splits, policy.overlap_ratio), policy.min_tile_size));
+    if (child_width >= tile_width && child_height >= tile_height) return children;
+
+    int num_h = calculateNumCuts(tile_width, child_width, policy.overlap_ratio);
+    int num_v = calculateNumCuts(tile_height, child_height, policy.overlap_ratio);
+    int step_x = child_width - overlapPixels(child_width, policy.overlap_ratio);
+    int step_y = child_height - overlapPixels(child_height, policy.overlap_ratio);
+
+    size_t max_values = policy.max_tiles > 0 ? static_cast<size_t>(policy.max_tiles) * 2 : 0;
+    int num_tiles = std::min(start_points.size() / 2, box_sizes.size());
+    for (int itile = 0; itile < num_tiles; ++itile)
+    {
+        if (!isDenseTile(policy, box_sizes[itile])) continue;
+
+        int tile_x = start_points[itile * 2];
+        int tile_y = start_points[itile * 2 + 1];
+        for (int i = 0; i < num_h; ++i)
+        {
+            int x = tile_x + std::min(i * step_x, tile_width - child_width);
+            x = std::max(0, std::min(width - child_width, x));
+            for (int j = 0; j < num_v; ++j)
+            {
+                if (max_values > 0 && children.size() >= max_values) return children;
+
+                int y = tile_y + std::min(j * step_y, tile_height - child_height);
+                y = std::max(0, std::min(height - child_height, y));
+                children.push_back(x);
+                children.push_back(y);
+            }
+        }
+    }
+    return children;
+}
+
+std::vector<uint8_t> rasterizeRoi(const Roi& roi, int width, int height, int& cols, int& rows)
+{
+    int cell = std::max(roi.cell, 1);
+    cols = ceil_div(std::max(width, 0), cell);
+    rows = ceil_div(std::max(height, 0), cell);
+    std::vector<uint8_t> cells((size_t)cols * rows, 1);
+
+    int num_points = (int)roi.polygon.size() / 2;
+    std::vector<float> crossings;
+    for (int row = 0; row < rows; ++row)
+    {
+        float y = (row + 0.5f) * cell;
+        uint8_t* pcells = cells.data() + (size_t)row * cols;
+
+        // even-odd scanline through the cell centres of this row
+        if (num_points >= 3)
+        {
+            crossings.clear();
+            for (int i = 0, j = num_points - 1; i < num_points; j = i++)
+            {
+                float xi = roi.polygon[i * 2], yi = roi.polygon[i * 2 + 1];
+                float xj = roi.polygon[j * 2], yj = roi.polygon[j * 2 + 1];
+                if ((yi > y) != (yj > y))
+                    crossings.push_back(xi + (y - yi) / (yj - yi) * (xj - xi));
+            }
+            std::sort(crossings.begin(), crossings.end());
+
+            size_t k = 0;
+            bool inside = false;
+            for (int col = 0; col < cols; ++col)
+            {
+                float x = (col + 0.5f) * cell;
+                while (k < crossings.size() && crossings[k] <= x) { inside = !inside; ++k; }
+                if (!inside) pcells[col] = 0;
+            }
+        }
+
+        if (roi.mask_width > 0 && roi.mask_height > 0 && (int)roi.mask.size() >= roi.mask_width * roi.mask_height)
+        {
+            int my = std::min(roi.mask_height - 1, static_cast<int>(y * roi.mask_height / height));
+            for (int col = 0; col < cols; ++col)
+            {
+                float x = (col + 0.5f) * cell;
+                int mx = std::min(roi.mask_width - 1, static_cast<int>(x * roi.mask_width / width));
+                if (roi.mask[(size_t)my * roi.mask_width + mx] == 0) pcells[col] = 0;
+            }
+        }
+    }
+    return cells;
+}
+
+bool roiIntersects(const std::vector<uint8_t>& cells, int cols, int rows, int cell, int x, int y, int w, int h)
+{
+    cell = std::max(cell, 1);
+    int col0 = std::max(0, x / cell);
+    int row0 = std::max(0, y / cell);
+    int col1 = std::min(cols - 1, (x + w - 1) / cell);
+    int row1 = std::min(rows - 1, (y + h - 1) / cell);
+    for (int row = row0; row <= row1; ++row)
+    {
+        const uint8_t* pcells = cells.data() + (size_t)row * cols;
+        for (int col = col0; col <= col1; ++col)
+            if (pcells[col]) return true;
+    }
+    return false;
+}
+
+static bool contains(const std::vector<int>& tiles, int tile_width, int tile_height,
+                     float left, float top, float right, float bottom)
+{
+    for (size_t i = 0; i < tiles.size(); i += 2)
+    {
+        if (tiles[i] <= left && tiles[i + 1] <= top &&
+            tiles[i] + tile_width >= right && tiles[i + 1] + tile_height >= bottom)
+            return true;
+    }
+    return false;
+}
+
+// tile origins along one axis covering [begin, end), centred when a single tile is enough
+static std::vector<int> cover_axis(float begin, float end, int dimension, int tile)
+{
+    int last = std::max(0, dimension - tile);
+    int extent = static_cast<int>(std::ceil(end - begin));
+    std::vector<int> origins;
+    if (extent <= tile)
+    {
+        int origin = static_cast<int>(std::floor((begin + end) * 0.5f - tile * 0.5f));
+        origins.push_back(std::max(0, std::min(last, origin)));
+        return origins;
+    }
+
+    int num  = calculateNumCuts(extent, tile, 0.2f);
+    int step = tile - overlapPixels(tile, 0.2f);
+    int first = static_cast<int>(std::floor(begin));
+    for (int i = 0; i < num; ++i)
+    {
+        int origin = std::min(first + i * step, static_cast<int>(std::ceil(end)) - tile);
+        origins.push_back(std::max(0, std::min(last, origin)));
+    }
+    return origins;
+}
+
+std::vector<int> selectRefineTiles(
+    const std::vector<Candidate>& candidates,
+    int width, int height, int tile_width, int tile_height,
+    const RefineOptions& options)
+{
+    std::vector<int> tiles;
+    if (width <= 0 || height <= 0 || tile_width <= 0 || tile_height <= 0) return tiles;
+
+    std::vector<Candidate> selected;
+    for (const Candidate& candidate : candidates)
+    {
+        float w = candidate.right - candidate.left;
+        float h = candidate.bottom - candidate.top;
+        if (w <= 0 || h <= 0) continue;
+        if (candidate.confidence < options.low_confidence || std::max(w, h) < options.small_size)
+            selected.push_back(candidate);
+    }
+    std::stable_sort(selected.begin(), selected.end(),
+                     [](const Candidate& a, const Candidate& b) { return a.confidence < b.confidence; });
+
+    size_t max_values = options.max_tiles > 0 ? static_cast<size_t>(options.max_tiles) * 2 : 0;
+    for (const Candidate& candidate : selected)
+    {
+        float margin_x = (candidate.right - candidate.left) * std::max(options.margin, 0.0f);
+        float margin_y = (candidate.bottom - candidate.top) * std::max(options.margin, 0.0f);
+        float left   = std::max(0.0f, candidate.left - margin_x);
+        float top    = std::max(0.0f, candidate.top - margin_y);
+        float right  = std::min(static_cast<float>(width), candidate.right + margin_x);
+        float bottom = std::min(static_cast<float>(height), candidate.bottom + margin_y);
+        if (right <= left || bottom <= top) continue;
+        if (contains(tiles, tile_width, tile_height, left, top, right, bottom)) continue;
+
+        for (int y : cover_axis(top, bottom, height, tile_height))
+        {
+            for (int x : cover_axis(left, right, width, tile_width))
+            {
+                if (max_values > 0 && tiles.size() >= max_values) return tiles;
+                bool duplicate = false;
+                for (size_t i = 0; i < tiles.size() && !duplicate; i += 2)
+                    duplicate = tiles[i] == x && tiles[i + 1] == y;
+                if (duplicate) continue;
+                tiles.push_back(x);
+                tiles.push_back(y);
+            }
+        }
+    }
+    return tiles;
+}
+
+}
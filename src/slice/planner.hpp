@@ -0,0 +1,200 @@
+#ifndef PLANNER_HPP__
+#define PLANNER_HPP__
+
+#include <cstdint>
+#include <tuple>
+#include <vector>
+
+namespace slice
+{
+
+// overlap in pixels used by SliceImage for a slice of sub_dimension pixels
+int overlapPixels(int subDimension, float overlapRatio);
+
+// number of slices needed to cover dimension, computed with the same integer step SliceImage uses
+int calculateNumCuts(int dimension, int subDimension, float overlapRatio);
+
+// x, y of every slice in the original image, the slice index is i * slice_num_v + j
+// where i runs horizontally and j vertically.
+// the last slice of a row or column is shifted back inside the image, without shift_edges it keeps
+// its step and is cropped by the image border instead
+std::vector<int> calculateSliceStartPoints(
+    int width, int height, int slice_width, int slice_height,
+    float overlap_width_ratio, float overlap_height_ratio,
+    int &slice_num_h, int &slice_num_v, bool shift_edges = true);
+
+// width, height of every slice once cropped by the image border
+std::vector<int> calculateSliceSizes(
+    const std::vector<int>& slice_start_point, int width, int height, int slice_width, int slice_height);
+
+// {left, top, right, bottom} of the core of every slice of a grid, the cores partition the plane.
+// neighbouring slices split their overlap in the middle, sides without a neighbour reach infinity
+static const int NUM_CORE_ELEMENT = 4;
+std::vector<float> calculateSliceCores(
+    const std::vector<int>& slice_start_point, int slice_num_h, int slice_num_v,
+    int slice_width, int slice_height);
+
+// cores of a grid once some slices are not inferred, e.g. dropped by the slice filter.
+// the side of a seen slice facing an overlapping slice that was not seen reaches infinity, the boxes of the
+// missing slice's share are then kept by every seen slice that can find them and nms removes the duplicates.
+// seen holds a flag per slice, items of cores past seen.size() (the full frame) are copied as they are
+std::vector<float> widenCores(
+    const std::vector<float>& cores, const std::vector<int>& slice_start_point,
+    int slice_width, int slice_height, const std::vector<uint8_t>& seen);
+
+// host reference of the decode ownership filter, a box belongs to the slice whose core holds its centre
+inline bool ownsBox(const float* core, float left, float top, float right, float bottom)
+{
+    float cx = (left + right) * 0.5f;
+    float cy = (top + bottom) * 0.5f;
+    return cx >= core[0] && cy >= core[1] && cx < core[2] && cy < core[3];
+}
+
+struct SliceGrid
+{
+    int slice_width  = 0;
+    int slice_height = 0;
+
+    // exact overlap in pixels and the ratio that reproduces it through overlapPixels
+    int overlap_width_pixel  = 0;
+    int overlap_height_pixel = 0;
+    float overlap_width_ratio  = 0.0f;
+    float overlap_height_ratio = 0.0f;
+
+    int slice_num_h = 0;
+    int slice_num_v = 0;
+
+    // number of engine rounds needed for the grid
+    int rounds = 0;
+
+    inline int slice_num() const { return slice_num_h * slice_num_v; }
+};
+
+// Host only, pure function of its inputs.
+// Finds the grid with the fewest tiles that
+//   1. covers the whole image,
+//   2. overlaps neighbouring tiles by at least min_overlap_ratio of the tile size,
+//   3. does not shrink the tile by more than min_scale_ratio when letterboxed to the network input.
+// Among grids with the same number of tiles the smallest tiles are returned.
+// The grid only depends on the image and network sizes and the two ratios, max_batch never changes it.
+struct SlicePlanner
+{
+    int network_width  = 640;
+    int network_height = 640;
+
+    float min_overlap_ratio = 0.2f;
+    float min_scale_ratio   = 0.5f;
+
+    // engine batch limit, only used to fill SliceGrid::rounds = ceil(tiles / max_batch)
+    int max_batch = 1;
+
+    SlicePlanner() = default;
+    SlicePlanner(int network_width, int network_height, float min_overlap_ratio, float min_scale_ratio, int max_batch)
+        : network_width(network_width),
+          network_height(network_height),
+          min_overlap_ratio(min_overlap_ratio),
+          min_scale_ratio(min_scale_ratio),
+          max_batch(max_batch) {}
+
+    SliceGrid plan(int width, int height) const;
+};
+
+// when a tile of the first grid pass is split into finer tiles and inferred again
+struct SubdivisionPolicy
+{
+    bool enabled = false;
+
+    // a tile is dense with at least min_boxes detections, or when the median longer side
+    // of its detections is below min_median_size pixels
+    int   min_boxes       = 16;
+    float min_median_size = 24.0f;
+
+    // a dense tile is covered by splits x splits children overlapping by overlap_ratio, never smaller than min_tile_size
+    int   splits        = 2;
+    float overlap_ratio = 0.2f;
+    int   min_tile_size = 128;
+
+    // upper bound on the number of children, 0 is unlimited
+    int max_tiles = 32;
+};
+
+// true when a tile with detections of the given longer sides should be subdivided
+bool isDenseTile(const SubdivisionPolicy& policy, std::vector<float> box_sizes);
+
+// smallest child size so that splits children overlapping by overlap_ratio cover tile pixels
+int childTileSize(int tile, int splits, float overlapRatio);
+
+// Host only, pure function of its inputs.
+// x, y of the children of every dense tile, tiles are given by their start points and the longer sides
+// of their detections. children are child_width x child_height and stay inside their parent and the frame
+std::vector<int> subdivideDenseTiles(
+    const std::vector<int>& start_points, int tile_width, int tile_height, int width, int height,
+    const std::vector<std::vector<float>>& box_sizes, const SubdivisionPolicy& policy,
+    int& child_width, int& child_height);
+
+// region of interest of a stream, a polygon, a bitmask or both (a pixel must be inside both).
+// an empty roi is the whole frame
+struct Roi
+{
+    // x0, y0, x1, y1, ... in image pixels
+    std::vector<float> polygon;
+
+    // mask_width x mask_height, non zero inside, stretched over the frame
+    std::vector<uint8_t> mask;
+    int mask_width  = 0;
+    int mask_height = 0;
+
+    // the roi is rasterized in cells of cell x cell pixels, a cell is inside when its centre is
+    int cell = 8;
+
+    inline bool enabled() const
+    {
+        return polygon.size() >= 6 || (mask_width > 0 && mask_height > 0 && (int)mask.size() >= mask_width * mask_height);
+    }
+};
+
+// cells of the roi over a width x height frame, cols = ceil(width / cell), rows = ceil(height / cell)
+std::vector<uint8_t> rasterizeRoi(const Roi& roi, int width, int height, int& cols, int& rows);
+
+// true when the x, y, w, h rectangle of the frame touches a cell inside the roi
+bool roiIntersects(const std::vector<uint8_t>& cells, int cols, int rows, int cell, int x, int y, int w, int h);
+
+// box found by the coarse pass, in original image pixels
+struct Candidate
+{
+    float left = 0, top = 0, right = 0, bottom = 0;
+    float confidence = 0;
+};
+
+// which coarse candidates are looked at again at full resolution and how much context they get
+struct RefineOptions
+{
+    // confidence threshold of the coarse pass, candidates below the model threshold can still be refined
+    float candidate_confidence = 0.1f;
+
+    // candidates below this confidence or smaller than small_size pixels on their longer side are refined
+    float low_confidence = 0.5f;
+    float small_size     = 64.0f;
+
+    // context added on every side of a candidate, as a fraction of its width and height
+    float margin = 1.0f;
+
+    // full resolution tile size, 0 uses the network input size
+    int tile_width  = 0;
+    int tile_height = 0;
+
+    // upper bound on the number of tiles, the least confident candidates are served first. 0 is unlimited
+    int max_tiles = 16;
+};
+
+// Host only, pure function of its inputs.
+// x, y of fixed size tiles covering the expanded neighbourhood of every refined candidate.
+// A neighbourhood already inside a tile adds nothing, one larger than a tile is covered by a small grid.
+std::vector<int> selectRefineTiles(
+    const std::vector<Candidate>& candidates,
+    int width, int height, int tile_width, int tile_height,
+    const RefineOptions& options);
+
+}
+
+#endif
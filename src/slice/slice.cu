@@ -1,6 +1,9 @@
 #include "slice/slice.hpp"
+#include "slice/color.hpp"
 #include "common/check.hpp"
 #include <cmath>
+#include <algorithm>
+#include <cstring>
 
 static __global__ void slice_kernel(
   const uchar3* __restrict__ image,
@@ -28,7 +31,7 @@ static __global__ void slice_kernel(
     const int dx = start_x + x;
     const int dy = start_y + y;
 
-    if(dx >= width || dy >= height) 
+    if(dx < 0 || dy < 0 || dx >= width || dy >= height) 
         return;
 
     // 读取像素
@@ -42,7 +45,7 @@ static __global__ void slice_kernel(
 
 static void slice_plane(const uint8_t* image,
     uint8_t* outs,
-    int* slice_start_point,
+    const int* slice_start_point,
     const int width,
     const int height,
     const int slice_width,
@@ -69,25 +72,125 @@ static void slice_plane(const uint8_t* image,
     );
 }
 
+// frames in another pixel format become the bgr frame every later step reads
+static __global__ void convert_to_bgr_kernel(
+  const tensor::Image image,
+  uint8_t* __restrict__ bgr)
+{
+    const int x = blockIdx.x * blockDim.x + threadIdx.x;
+    const int y = blockIdx.y * blockDim.y + threadIdx.y;
+    if (x >= image.width || y >= image.height) return;
 
-namespace slice
+    slice::load_bgr(image, x, y, bgr + ((size_t)y * image.width + x) * 3);
+}
+
+static __device__ float gray_level(const uint8_t* p)
+{
+    return 0.114f * p[0] + 0.587f * p[1] + 0.299f * p[2];
+}
+
+static __global__ void slice_statistics_kernel(
+  const uint8_t* __restrict__ image,
+  const int* __restrict__ slice_start_point,
+  const int width,
+  const int height,
+  const int slice_width,
+  const int slice_height,
+  const int step,
+  float* __restrict__ statistics)
 {
+    __shared__ float shared[3][256];
+
+    const int slice_idx = blockIdx.y;
+    const int start_x = slice_start_point[slice_idx * 2];
+    const int start_y = slice_start_point[slice_idx * 2 + 1];
+    const int valid_w = min(slice_width, width - start_x);
+    const int valid_h = min(slice_height, height - start_y);
+    const int cols = (valid_w + step - 1) / step;
+    const int rows = (valid_h + step - 1) / step;
 
-int calculateNumCuts(int dimension, int subDimension, float overlapRatio) {
-    float step = subDimension * (1 - overlapRatio);
-    if(step == 0)
+    float sum = 0, sumsq = 0, edge = 0;
+    for (int i = blockIdx.x * blockDim.x + threadIdx.x; i < cols * rows; i += blockDim.x * gridDim.x)
     {
-        return 1;
+        const int x = (i % cols) * step;
+        const int y = (i / cols) * step;
+        const uint8_t* p = image + ((size_t)(start_y + y) * width + start_x + x) * 3;
+        const float g = gray_level(p);
+        sum   += g;
+        sumsq += g * g;
+        if (x + step < valid_w) edge += fabsf(gray_level(p + step * 3) - g);
+        if (y + step < valid_h) edge += fabsf(gray_level(p + (size_t)step * width * 3) - g);
     }
-    float cuts = static_cast<float>(dimension - subDimension) / step;
-    // 浮点数会有很小的误差，直接向上取整会出现多裁剪了一张图的情况
-    if (fabs(cuts - round(cuts)) < 0.0001) {
-        cuts = round(cuts);
+
+    shared[0][threadIdx.x] = sum;
+    shared[1][threadIdx.x] = sumsq;
+    shared[2][threadIdx.x] = edge;
+    __syncthreads();
+    for (int offset = blockDim.x / 2; offset > 0; offset >>= 1)
+    {
+        if (threadIdx.x < offset)
+        {
+            shared[0][threadIdx.x] += shared[0][threadIdx.x + offset];
+            shared[1][threadIdx.x] += shared[1][threadIdx.x + offset];
+            shared[2][threadIdx.x] += shared[2][threadIdx.x + offset];
+        }
+        __syncthreads();
+    }
+
+    if (threadIdx.x == 0)
+    {
+        float* pstat = statistics + slice_idx * slice::NUM_SLICE_STATISTICS;
+        atomicAdd(pstat + 0, shared[0][0]);
+        atomicAdd(pstat + 1, shared[1][0]);
+        atomicAdd(pstat + 2, shared[2][0]);
+        if (blockIdx.x == 0) pstat[3] = cols * rows;
     }
-    int numCuts = static_cast<int>(std::ceil(cuts));
-    return numCuts + 1;
 }
 
+static __global__ void slice_difference_kernel(
+  const uint8_t* __restrict__ image,
+  const uint8_t* __restrict__ previous,
+  const int* __restrict__ slice_start_point,
+  const int width,
+  const int height,
+  const int slice_width,
+  const int slice_height,
+  const int step,
+  float* __restrict__ difference)
+{
+    __shared__ float shared[256];
+
+    const int slice_idx = blockIdx.y;
+    const int start_x = slice_start_point[slice_idx * 2];
+    const int start_y = slice_start_point[slice_idx * 2 + 1];
+    const int cols = (min(slice_width, width - start_x) + step - 1) / step;
+    const int rows = (min(slice_height, height - start_y) + step - 1) / step;
+
+    float sum = 0;
+    for (int i = blockIdx.x * blockDim.x + threadIdx.x; i < cols * rows; i += blockDim.x * gridDim.x)
+    {
+        const size_t offset = ((size_t)(start_y + (i / cols) * step) * width + start_x + (i % cols) * step) * 3;
+        sum += fabsf(gray_level(image + offset) - gray_level(previous + offset));
+    }
+
+    shared[threadIdx.x] = sum;
+    __syncthreads();
+    for (int offset = blockDim.x / 2; offset > 0; offset >>= 1)
+    {
+        if (threadIdx.x < offset) shared[threadIdx.x] += shared[threadIdx.x + offset];
+        __syncthreads();
+    }
+
+    if (threadIdx.x == 0)
+    {
+        atomicAdd(difference + slice_idx * 2, shared[0]);
+        if (blockIdx.x == 0) difference[slice_idx * 2 + 1] = cols * rows;
+    }
+}
+
+namespace slice
+{
+
 static int calc_resolution_factor(int resolution)
 {
     int expo = 0;
@@ -197,6 +300,91 @@ void SliceImage::autoSlice(
     slice(image, slice_width, slice_height, overlap_width_ratio, overlap_height_ratio, stream);
 }
 
+void SliceImage::autoSlice(
+        const tensor::Image& image,
+        const SlicePlanner& planner,
+        void* stream)
+{
+    SliceGrid grid = planner.plan(image.width, image.height);
+    slice(image, grid.slice_width, grid.slice_height, grid.overlap_width_ratio, grid.overlap_height_ratio, stream);
+}
+
+SliceImage::~SliceImage()
+{
+    for (int i = 0; i < NUM_FRAME_SLOTS; ++i)
+    {
+        if (uploaded_[i]) cudaEventDestroy(uploaded_[i]);
+        if (released_[i]) cudaEventDestroy(released_[i]);
+    }
+    if (points_uploaded_) cudaEventDestroy(points_uploaded_);
+    if (copy_stream_) cudaStreamDestroy(copy_stream_);
+}
+
+void SliceImage::create_streams()
+{
+    if (copy_stream_ != nullptr) return;
+    checkRuntime(cudaStreamCreateWithFlags(&copy_stream_, cudaStreamNonBlocking));
+    for (int i = 0; i < NUM_FRAME_SLOTS; ++i)
+    {
+        checkRuntime(cudaEventCreateWithFlags(&uploaded_[i], cudaEventDisableTiming));
+        checkRuntime(cudaEventCreateWithFlags(&released_[i], cudaEventDisableTiming));
+    }
+    checkRuntime(cudaEventCreateWithFlags(&points_uploaded_, cudaEventDisableTiming));
+}
+
+uint8_t* SliceImage::staging_buffer(int width, int height)
+{
+    create_streams();
+    int slot = (frame_slot_ + 1) % NUM_FRAME_SLOTS;
+    // the last upload from this slot may still be reading it
+    checkRuntime(cudaEventSynchronize(uploaded_[slot]));
+    return frames_[slot].cpu((size_t)width * height * 3);
+}
+
+void SliceImage::next_frame(cudaStream_t stream)
+{
+    create_streams();
+    // everything queued so far belongs to the frame in the current slot
+    checkRuntime(cudaEventRecord(released_[frame_slot_], stream));
+    frame_slot_ = (frame_slot_ + 1) % NUM_FRAME_SLOTS;
+}
+
+void SliceImage::upload_frame(const uint8_t* src, size_t src_line_size, int width, int height, cudaStream_t stream)
+{
+    tensor::Memory<unsigned char>& frame = frames_[frame_slot_];
+    size_t line_size  = (size_t)width * 3;
+    size_t size_image = line_size * height;
+    uint8_t* device   = frame.gpu(size_image);
+
+    if (!staging_)
+    {
+        // pageable memory, the driver stages the copy itself and the call returns when it is done
+        if (src_line_size != line_size)
+            checkRuntime(cudaMemcpy2DAsync(device, line_size, src, src_line_size, line_size, height, cudaMemcpyHostToDevice, stream));
+        else
+            checkRuntime(cudaMemcpyAsync(device, src, size_image, cudaMemcpyHostToDevice, stream));
+        return;
+    }
+
+    // frames decoded into staging_buffer() are already in place
+    uint8_t* staging = frame.cpu();
+    if (src != staging || src_line_size != line_size || frame.cpu_bytes() < size_image)
+    {
+        checkRuntime(cudaEventSynchronize(uploaded_[frame_slot_]));
+        staging = frame.cpu(size_image);
+        #pragma omp parallel for schedule(static)
+        for (int y = 0; y < height; ++y)
+            memcpy(staging + y * line_size, src + (size_t)y * src_line_size, line_size);
+    }
+
+    // the device slot is free once the work of the frame that used it before has run,
+    // the compute stream only waits for the copy itself
+    checkRuntime(cudaStreamWaitEvent(copy_stream_, released_[frame_slot_], 0));
+    checkRuntime(cudaMemcpyAsync(device, staging, size_image, cudaMemcpyHostToDevice, copy_stream_));
+    checkRuntime(cudaEventRecord(uploaded_[frame_slot_], copy_stream_));
+    checkRuntime(cudaStreamWaitEvent(stream, uploaded_[frame_slot_], 0));
+}
+
 void SliceImage::slice(
         const tensor::Image& image, 
         const int slice_width,
@@ -205,91 +393,279 @@ void SliceImage::slice(
         const float overlap_height_ratio,
         void* stream)
 {
-    slice_width_  = slice_width;
-    slice_height_ = slice_height;
+    cudaStream_t stream_ = (cudaStream_t)stream;
+
+    int slice_num_h, slice_num_v;
+    std::vector<int> points = calculateSliceStartPoints(
+        image.width, image.height, slice_width, slice_height,
+        overlap_width_ratio, overlap_height_ratio, slice_num_h, slice_num_v);
+    int slice_num = slice_num_h * slice_num_v;
+
+    // the points are pinned, the copy stays asynchronous. only the previous copy has to be done before they are overwritten
+    create_streams();
+    checkRuntime(cudaEventSynchronize(points_uploaded_));
+    slice_start_point_.cpu(slice_num * 2);
+    slice_start_point_.gpu(slice_num * 2);
+    memcpy(slice_start_point_.cpu(), points.data(), slice_num * 2 * sizeof(int));
+    checkRuntime(cudaMemcpyAsync(slice_start_point_.gpu(), slice_start_point_.cpu(), slice_num*2*sizeof(int), cudaMemcpyHostToDevice, stream_));
+    checkRuntime(cudaEventRecord(points_uploaded_, stream_));
+
+    slice(image, slice_width, slice_height, slice_num_h, slice_num_v, slice_start_point_, stream);
+}
+
+void SliceImage::slice(
+        const tensor::Image& image,
+        const int slice_width,
+        const int slice_height,
+        const int slice_num_h,
+        const int slice_num_v,
+        const tensor::Memory<int>& slice_start_point,
+        void* stream)
+{
     cudaStream_t stream_ = (cudaStream_t)stream;
 
     int width = image.width;
     int height = image.height;
+    image_width_  = width;
+    image_height_ = height;
+    size_t size_image = 3 * width * height;
+    next_frame(stream_);
 
-    slice_num_h_ = calculateNumCuts(width, slice_width, overlap_width_ratio);
-    slice_num_v_ = calculateNumCuts(height, slice_height, overlap_height_ratio);
-    // printf("------------------------------------------------------\n"
-    //     "CUDA SAHI CROP IMAGE ✂️\n"
-    //     "------------------------------------------------------\n"
-    //     "%-30s: %-10d\n"
-    //     "%-30s: %-10d\n"
-    //     "%-30s: %-10.2f\n"
-    //     "%-30s: %-10.2f\n"
-    //     "%-30s: %-10d\n"
-    //     "%-30s: %-10d\n"
-    //     "------------------------------------------------------\n", 
-    //     "Slice width", slice_width_,
-    //     "Slice height", slice_height_,
-    //     "Overlap width ratio", overlap_width_ratio,
-    //     "Overlap height ratio", overlap_height_ratio,
-    //     "Number of horizontal cuts", slice_num_h_,
-    //     "Number of vertical cuts", slice_num_v_);
-    int slice_num            = slice_num_h_ * slice_num_v_;
-    int overlap_width_pixel  = slice_width  * overlap_width_ratio;
-    int overlap_height_pixel = slice_height * overlap_height_ratio;
+    if (image.format == tensor::PixelFormat::BGR)
+    {
+        // roi views and padded rows: the device copy is compacted by a 2d copy, the host crops need tight rows
+        size_t line_size = 3 * width;
+        bool strided = (size_t)image.line_size(0) != line_size;
+        host_image_ = (const uint8_t*)image.planes[0];
+        if (strided && backend_ == SliceBackend::Host)
+        {
+            uint8_t* compact = converted_image_.cpu(size_image);
+            #pragma omp parallel for schedule(static)
+            for (int y = 0; y < height; ++y)
+                memcpy(compact + y * line_size, host_image_ + (size_t)y * image.line_size(0), line_size);
+            host_image_ = compact;
+        }
 
-    size_t size_image = 3 * width * height;
+        // the host backend crops on the cpu cores, the full image only goes to the device when asked for
+        if (backend_ != SliceBackend::Host || upload_frame_)
+        {
+            size_t src_line_size = backend_ == SliceBackend::Host ? line_size : image.line_size(0);
+            upload_frame(host_image_, src_line_size, width, height, stream_);
+        }
+    }
+    else if (backend_ == SliceBackend::Host)
+    {
+        // converted on the cpu cores next to the crops
+        host_image_ = converted_image_.cpu(size_image);
+        convert_to_bgr_host(image, converted_image_.cpu());
+        if (upload_frame_) upload_frame(host_image_, 3 * width, width, height, stream_);
+    }
+    else
+    {
+        // the planes go up as they are (NV12 is half the bytes of BGR) and are converted on the device
+        host_image_ = nullptr;
+        tensor::Image source = image;
+        size_t size_source = 0;
+        for (int i = 0; i < image.num_planes(); ++i) size_source += (size_t)image.row_bytes(i) * image.plane_rows(i);
+
+        uint8_t* pdst = source_image_.gpu(size_source);
+        for (int i = 0; i < image.num_planes(); ++i)
+        {
+            checkRuntime(cudaMemcpy2DAsync(pdst, image.row_bytes(i), image.planes[i], image.line_size(i),
+                                           image.row_bytes(i), image.plane_rows(i), cudaMemcpyHostToDevice, stream_));
+            source.planes[i]  = pdst;
+            source.strides[i] = image.row_bytes(i);
+            pdst += (size_t)image.row_bytes(i) * image.plane_rows(i);
+        }
+
+        uint8_t* device = frames_[frame_slot_].gpu(size_image);
+        dim3 block(32, 8);
+        dim3 grid((width + block.x - 1) / block.x, (height + block.y - 1) / block.y);
+        checkKernel(convert_to_bgr_kernel<<<grid, block, 0, stream_>>>(source, device));
+    }
+
+    reslice(slice_width, slice_height, slice_num_h, slice_num_v, slice_start_point, stream);
+}
+
+void SliceImage::reslice(
+        const int slice_width,
+        const int slice_height,
+        const int slice_num_h,
+        const int slice_num_v,
+        const tensor::Memory<int>& slice_start_point,
+        void* stream)
+{
+    slice_width_  = slice_width;
+    slice_height_ = slice_height;
+    slice_num_h_  = slice_num_h;
+    slice_num_v_  = slice_num_v;
+    cudaStream_t stream_ = (cudaStream_t)stream;
+
+    int slice_num = slice_num_h_ * slice_num_v_;
     size_t output_img_size = 3 * slice_width * slice_height;
+    if (slice_num == 0) return;
+
+    if (backend_ == SliceBackend::Host)
+    {
+        // upload the slices once
+        output_images_.cpu(slice_num * output_img_size);
+        output_images_.gpu(slice_num * output_img_size);
+        slice_plane_host(
+            host_image_, output_images_.cpu(), slice_start_point.cpu(),
+            image_width_, image_height_,
+            slice_width, slice_height,
+            slice_num);
+        checkRuntime(cudaMemcpyAsync(output_images_.gpu(), output_images_.cpu(), output_images_.gpu_bytes(), cudaMemcpyHostToDevice, stream_));
+        return;
+    }
+
+    // views are read in place by preprocess, nothing to copy
+    if (mode_ == SliceMode::View) return;
 
-    input_image_.gpu(size_image);
     output_images_.gpu(slice_num * output_img_size);
     checkRuntime(cudaMemsetAsync(output_images_.gpu(), 114, output_images_.gpu_bytes(), stream_));
 
-    checkRuntime(cudaMemcpyAsync(input_image_.gpu(), image.bgrptr, size_image, cudaMemcpyHostToDevice, stream_));
-    // checkRuntime(cudaStreamSynchronize(stream_));
+    slice_plane(
+        input_image(), output_images_.gpu(), slice_start_point.gpu(),
+        image_width_, image_height_,
+        slice_width, slice_height, 
+        slice_num_h_, slice_num_v_,
+        stream);
+}
+
+int SliceImage::select(
+        const SliceFilter& filter,
+        const tensor::Memory<int>& slice_start_point,
+        std::vector<int>& slices,
+        void* stream)
+{
+    int slice_num = slice_num_h_ * slice_num_v_;
+    slices.resize(slice_num);
+    for (int i = 0; i < slice_num; ++i) slices[i] = i;
+    if (!filter.enabled() || slice_num == 0) return 0;
+
+    float* statistics = slice_statistics_.cpu(slice_num * NUM_SLICE_STATISTICS);
+    memset(statistics, 0, slice_statistics_.cpu_bytes());
+    if (filter.type != FilterType::None)
+    {
+        int step = std::max(filter.step, 1);
+        if (backend_ == SliceBackend::Host)
+        {
+            slice_statistics_host(
+                host_image_, slice_start_point.cpu(),
+                image_width_, image_height_,
+                slice_width_, slice_height_,
+                slice_num, step, statistics);
+        }
+        else
+        {
+            // the only sync of the frame before inference, the kept slices decide the batch and the engine dims.
+            // the statistics are queued behind everything already on the stream, so this also waits for the
+            // earlier frames still in flight; the host backend computes them on the cpu without a sync
+            cudaStream_t stream_ = (cudaStream_t)stream;
+            float* statistics_device = slice_statistics_.gpu(slice_num * NUM_SLICE_STATISTICS);
+            checkRuntime(cudaMemsetAsync(statistics_device, 0, slice_statistics_.gpu_bytes(), stream_));
+            dim3 block(256);
+            dim3 grid(8, slice_num);
+            checkKernel(slice_statistics_kernel<<<grid, block, 0, stream_>>>(
+                input_image(), slice_start_point.gpu(),
+                image_width_, image_height_,
+                slice_width_, slice_height_,
+                step, statistics_device));
+            checkRuntime(cudaMemcpyAsync(statistics, statistics_device, slice_statistics_.gpu_bytes(), cudaMemcpyDeviceToHost, stream_));
+            checkRuntime(cudaStreamSynchronize(stream_));
+        }
+    }
 
-    uint8_t* input_device = input_image_.gpu();
-    uint8_t* output_device = output_images_.gpu();
+    slices.clear();
+    for (int i = 0; i < slice_num; ++i)
+    {
+        if (keep_slice(filter, i, statistics + i * NUM_SLICE_STATISTICS)) slices.push_back(i);
+    }
+    return slice_num - (int)slices.size();
+}
 
-    slice_start_point_.cpu(slice_num * 2);
-    slice_start_point_.gpu(slice_num * 2);
+void SliceImage::difference(
+        const tensor::Memory<int>& slice_start_point,
+        const int step,
+        std::vector<float>& differences,
+        void* stream)
+{
+    int slice_num = slice_num_h_ * slice_num_v_;
+    int sample_step = std::max(step, 1);
+    size_t size_image = 3 * image_width_ * image_height_;
+    bool has_previous = previous_width_ == image_width_ && previous_height_ == image_height_ && slice_num > 0;
+    cudaStream_t stream_ = (cudaStream_t)stream;
 
-    int* slice_start_point_ptr = slice_start_point_.cpu();
-    
-    for (int i = 0; i < slice_num_h_; i++)
+    differences.assign(slice_num, -1.0f);
+    float* difference = slice_difference_.cpu(slice_num * 2);
+    if (backend_ == SliceBackend::Host)
     {
-        int x = std::min(width - slice_width, std::max(0, i * (slice_width - overlap_width_pixel)));
-        for (int j = 0; j < slice_num_v_; j++)
+        uint8_t* previous = previous_image_.cpu(size_image);
+        if (has_previous)
         {
-            int y = std::min(height - slice_height, std::max(0, j * (slice_height - overlap_height_pixel)));
-            int index = (i * slice_num_v_ + j) * 2;
-            slice_start_point_ptr[index] = x;
-            slice_start_point_ptr[index + 1] = y;
+            slice_difference_host(
+                host_image_, previous, slice_start_point.cpu(),
+                image_width_, image_height_,
+                slice_width_, slice_height_,
+                slice_num, sample_step, difference);
         }
+        memcpy(previous, host_image_, size_image);
     }
-    
-    checkRuntime(cudaMemcpyAsync(slice_start_point_.gpu(), slice_start_point_.cpu(), slice_num*2*sizeof(int), cudaMemcpyHostToDevice, stream_));
-    checkRuntime(cudaStreamSynchronize(stream_));
-    slice_plane(
-        input_device, output_device, slice_start_point_.gpu(),
-        width, height, 
-        slice_width, slice_height, 
-        slice_num_h_, slice_num_v_,
-        stream);
+    else
+    {
+        uint8_t* previous = previous_image_.gpu(size_image);
+        if (has_previous)
+        {
+            float* difference_device = slice_difference_.gpu(slice_num * 2);
+            checkRuntime(cudaMemsetAsync(difference_device, 0, slice_difference_.gpu_bytes(), stream_));
+            dim3 block(256);
+            dim3 grid(8, slice_num);
+            checkKernel(slice_difference_kernel<<<grid, block, 0, stream_>>>(
+                input_image(), previous, slice_start_point.gpu(),
+                image_width_, image_height_,
+                slice_width_, slice_height_,
+                sample_step, difference_device));
+            checkRuntime(cudaMemcpyAsync(difference, difference_device, slice_difference_.gpu_bytes(), cudaMemcpyDeviceToHost, stream_));
+        }
+        checkRuntime(cudaMemcpyAsync(previous, input_image(), size_image, cudaMemcpyDeviceToDevice, stream_));
+        if (has_previous) checkRuntime(cudaStreamSynchronize(stream_));
+    }
+    previous_width_  = image_width_;
+    previous_height_ = image_height_;
 
-    // checkRuntime(cudaStreamSynchronize(stream_));
-
-    // for (int i = 0; i < slice_num_h_; i++)
-    // {
-    //     for (int j = 0; j < slice_num_v_; j++)
-    //     {
-    //         int index = i * slice_num_v_ + j;
-    //         slice_position_[index*2]   = slice_start_point_ptr[index*2];
-    //         slice_position_[index*2+1] = slice_start_point_ptr[index*2+1];
-
-    //         // cv::Mat image = cv::Mat::zeros(slice_height, slice_width, CV_8UC3);
-    //         // uint8_t* output_img_data = image.ptr<uint8_t>();
-    //         // cudaMemcpyAsync(output_img_data, output_device+index*output_img_size, output_img_size*sizeof(uint8_t), cudaMemcpyDeviceToHost, stream_);
-    //         // checkRuntime(cudaStreamSynchronize(stream_));
-    //         // cv::imwrite(std::to_string(index) + ".png", image);
-    //     }
-    // }
+    if (!has_previous) return;
+    for (int i = 0; i < slice_num; ++i)
+        differences[i] = difference[i * 2] / std::max(difference[i * 2 + 1], 1.0f);
 }
 
-}
\ No newline at end of file
+TileView SliceImage::tile(int islice, int start_x, int start_y, int width, int height) const
+{
+    // pixels past the right or bottom edge of the frame fall back to the border value exactly like the padded copy
+    TileView view;
+    view.width  = std::min(width, image_width_ - start_x);
+    view.height = std::min(height, image_height_ - start_y);
+    if (materialized())
+    {
+        view.data      = output_images_.gpu() + (size_t)islice * slice_width_ * slice_height_ * 3;
+        view.line_size = slice_width_ * 3;
+    }
+    else
+    {
+        view.data      = input_image() + ((size_t)start_y * image_width_ + start_x) * 3;
+        view.line_size = image_width_ * 3;
+    }
+    return view;
+}
+
+TileView SliceImage::frame() const
+{
+    TileView view;
+    view.data      = input_image();
+    view.line_size = image_width_ * 3;
+    view.width     = image_width_;
+    view.height    = image_height_;
+    return view;
+}
+
+}
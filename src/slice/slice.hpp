@@ -4,19 +4,174 @@
 #include "opencv2/opencv.hpp"
 #include "common/image.hpp"
 #include "common/memory.hpp"
+#include "slice/planner.hpp"
+#include <cuda_runtime.h>
 #include <vector>
 
 namespace slice
 {
 
-int calculateNumCuts(int dimension, int subDimension, float overlapRatio);
+enum class SliceMode : int
+{
+    Materialize = 0,  // copy every slice into output_images_
+    View        = 1   // slices are only described, preprocess reads them in place from the device frame
+};
+
+enum class SliceBackend : int
+{
+    CUDA = 0,  // slice_kernel on the device
+    Host = 1   // AVX2 row copies on the host, OpenMP across slices, then one upload of all slices.
+               // the crops move to the cpu cores but SliceImage still needs a device, see slice_image_host
+};
+
+// host twin of the cuda slice kernel, byte identical output, no cuda required
+void slice_plane_host(
+    const uint8_t* image,
+    uint8_t* outs,
+    const int* slice_start_point,
+    const int width,
+    const int height,
+    const int slice_width,
+    const int slice_height,
+    const int slice_num,
+    const uint8_t const_value = 114);
+
+// host only entry point of the host backend, no cuda runtime call: the slices of a frame in any pixel format
+// and with any row stride, converted and cropped on the cpu into outs (slice_num * slice_width * slice_height * 3
+// bytes), the same bytes SliceImage produces with either backend
+void slice_image_host(
+    const tensor::Image& image,
+    uint8_t* outs,
+    const int* slice_start_point,
+    const int slice_width,
+    const int slice_height,
+    const int slice_num,
+    const uint8_t const_value = 114);
+
+enum class FilterType : int
+{
+    None       = 0,
+    Variance   = 1,  // variance of the gray level
+    EdgeEnergy = 2   // mean absolute gradient of the gray level
+};
+
+// drops slices without content (sky, water, tarmac) before they reach the engine
+struct SliceFilter
+{
+    FilterType type = FilterType::None;
+
+    // slices whose statistic is below the threshold are skipped
+    float threshold = 0.0f;
+
+    // statistics are computed on every step-th pixel in both directions
+    int step = 4;
+
+    // optional keep flag per slice of the grid, 0 skips the slice whatever its content
+    std::vector<uint8_t> mask;
+
+    inline bool enabled() const { return type != FilterType::None || !mask.empty(); }
+};
+
+// re-infers only the slices that changed since the previous frame, for static cameras
+struct MotionGate
+{
+    bool enabled = false;
+
+    // mean absolute gray difference below which a slice counts as unchanged
+    float threshold = 2.0f;
+
+    // differences are computed on every step-th pixel in both directions
+    int step = 4;
+
+    // every refresh_interval frames all slices are inferred again, 0 never forces a refresh
+    int refresh_interval = 0;
+};
+
+// {sum, sum of squares, sum of absolute gradients, number of samples} of the sampled gray level of every slice
+static const int NUM_SLICE_STATISTICS = 4;
+
+// host twin of the cuda statistics kernel
+void slice_statistics_host(
+    const uint8_t* image,
+    const int* slice_start_point,
+    const int width,
+    const int height,
+    const int slice_width,
+    const int slice_height,
+    const int slice_num,
+    const int step,
+    float* statistics);
+
+// host twin of the cuda difference kernel, {sum of absolute gray differences, number of samples} of every slice
+void slice_difference_host(
+    const uint8_t* image,
+    const uint8_t* previous,
+    const int* slice_start_point,
+    const int width,
+    const int height,
+    const int slice_width,
+    const int slice_height,
+    const int slice_num,
+    const int step,
+    float* difference);
+
+// true when the slice passes the filter, statistics points at the slice's NUM_SLICE_STATISTICS values
+bool keep_slice(const SliceFilter& filter, int islice, const float* statistics);
+
+// a slice as seen by preprocess, pixels outside width x height are the border value
+struct TileView
+{
+    const uint8_t* data = nullptr;
+    int line_size = 0;
+    int width     = 0;
+    int height    = 0;
+};
+
+// frames in the upload ring, as many as frames in flight so that queuing one never waits for the gpu
+static const int NUM_FRAME_SLOTS = 4;
 
 class SliceImage{
 public:
-    tensor::Memory<unsigned char> input_image_;
+    // upload ring of the frames. cpu() of a slot is pinned staging memory and gpu() the device frame,
+    // frame n+1 is copied on copy_stream_ while work queued for the earlier frames still reads the other slots
+    tensor::Memory<unsigned char> frames_[NUM_FRAME_SLOTS];
+    int frame_slot_ = 0;
+    cudaStream_t copy_stream_ = nullptr;
+    cudaEvent_t uploaded_[NUM_FRAME_SLOTS] = {};   // h2d copy of the slot, recorded on copy_stream_
+    cudaEvent_t released_[NUM_FRAME_SLOTS] = {};   // last work reading the slot, recorded on the compute stream
+
+    // bgr frames go through the pinned staging memory, false uploads straight from the caller's memory
+    bool staging_ = true;
+
     tensor::Memory<unsigned char> output_images_;
 
     tensor::Memory<int> slice_start_point_;
+    cudaEvent_t points_uploaded_ = nullptr;
+    tensor::Memory<float> slice_statistics_;
+
+    // frame seen by the previous call of difference()
+    tensor::Memory<unsigned char> previous_image_;
+    tensor::Memory<float> slice_difference_;
+    int previous_width_  = 0;
+    int previous_height_ = 0;
+
+    SliceMode mode_ = SliceMode::Materialize;
+    SliceBackend backend_ = SliceBackend::CUDA;
+
+    int image_width_  = 0;
+    int image_height_ = 0;
+
+    // caller's frame, only valid during the forward that sliced it.
+    // frames in other pixel formats point at converted_image_ (host backend) or are only on the device
+    const uint8_t* host_image_ = nullptr;
+
+    // planes of a non bgr frame on the device, and its bgr conversion (or a compact copy of strided bgr rows)
+    // on the host for the host backend
+    tensor::Memory<unsigned char> source_image_;
+    tensor::Memory<unsigned char> converted_image_;
+
+    // the host backend also uploads the whole frame, needed when the frame itself is inferred next to the slices
+    bool upload_frame_ = false;
 
     int slice_num_h_;
     int slice_num_v_;
@@ -26,7 +181,25 @@ public:
 
     // std::vector<int> slice_position_;
 
+private:
+    void create_streams();
+
+    // the next slot of the ring becomes the current frame
+    void next_frame(cudaStream_t stream);
+
+    // tight bgr rows of src to the current device frame, through the staging memory unless staging_ is off
+    void upload_frame(const uint8_t* src, size_t src_line_size, int width, int height, cudaStream_t stream);
+
 public:
+    ~SliceImage();
+
+    // device frame of the last slice() call
+    inline uint8_t* input_image() const { return frames_[frame_slot_].gpu(); }
+
+    // pinned memory of the next frame, a width x height bgr frame decoded into it is uploaded without a host copy.
+    // valid until the next slice() call
+    uint8_t* staging_buffer(int width, int height);
+
     void slice(
         const tensor::Image& image, 
         const int slice_width,
@@ -34,10 +207,60 @@ public:
         const float overlap_width_ratio,
         const float overlap_height_ratio,
         void* stream=nullptr);
+
+    // slice with start points prepared ahead of time, they must be on the host and the device.
+    // the points need not form a grid, slice_num_h x slice_num_v only gives their number
+    void slice(
+        const tensor::Image& image,
+        const int slice_width,
+        const int slice_height,
+        const int slice_num_h,
+        const int slice_num_v,
+        const tensor::Memory<int>& slice_start_point,
+        void* stream=nullptr);
     
+    // slice the frame of the last slice() call again with other start points, the frame is not uploaded again
+    void reslice(
+        const int slice_width,
+        const int slice_height,
+        const int slice_num_h,
+        const int slice_num_v,
+        const tensor::Memory<int>& slice_start_point,
+        void* stream=nullptr);
+
     void autoSlice(
         const tensor::Image& image, 
         void* stream=nullptr);
+
+    // grid chosen from the network input size and the engine batch instead of the resolution heuristic
+    void autoSlice(
+        const tensor::Image& image,
+        const SlicePlanner& planner,
+        void* stream=nullptr);
+
+    // indices of the slices that pass the filter, returns the number of skipped slices
+    int select(
+        const SliceFilter& filter,
+        const tensor::Memory<int>& slice_start_point,
+        std::vector<int>& slices,
+        void* stream=nullptr);
+
+    // mean absolute gray difference of every slice to the previous frame, all negative without a previous frame.
+    // the current frame becomes the previous one
+    void difference(
+        const tensor::Memory<int>& slice_start_point,
+        const int step,
+        std::vector<float>& differences,
+        void* stream=nullptr);
+
+    // the host backend always produces real slices, views only exist on the device
+    inline bool materialized() const { return mode_ == SliceMode::Materialize || backend_ == SliceBackend::Host; }
+
+    // device view of the width x height slice islice starting at (start_x, start_y), valid for both modes
+    TileView tile(int islice, int start_x, int start_y, int width, int height) const;
+
+    // device view of the whole frame
+    TileView frame() const;
 };
 
 
@@ -0,0 +1,226 @@
+#include "slice/slice.hpp"
+#include "slice/color.hpp"
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SLICE_HOST_X86 1
+#endif
+
+namespace slice
+{
+
+static void copy_row(uint8_t* dst, const uint8_t* src, size_t bytes)
+{
+    memcpy(dst, src, bytes);
+}
+
+#ifdef SLICE_HOST_X86
+__attribute__((target("avx2")))
+static void copy_row_avx2(uint8_t* dst, const uint8_t* src, size_t bytes)
+{
+    size_t i = 0;
+    for (; i + 64 <= bytes; i += 64)
+    {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 32));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), a);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i + 32), b);
+    }
+    for (; i + 32 <= bytes; i += 32)
+    {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), a);
+    }
+    if (i < bytes) memcpy(dst + i, src + i, bytes - i);
+}
+#endif
+
+typedef void (*copy_row_fn)(uint8_t*, const uint8_t*, size_t);
+
+static copy_row_fn select_copy_row()
+{
+#ifdef SLICE_HOST_X86
+    if (__builtin_cpu_supports("avx2")) return copy_row_avx2;
+#endif
+    return copy_row;
+}
+
+void slice_plane_host(
+    const uint8_t* image,
+    uint8_t* outs,
+    const int* slice_start_point,
+    const int width,
+    const int height,
+    const int slice_width,
+    const int slice_height,
+    const int slice_num,
+    const uint8_t const_value)
+{
+    static const copy_row_fn copy = select_copy_row();
+    const size_t line_size  = (size_t)slice_width * 3;
+    const size_t slice_size = line_size * slice_height;
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int islice = 0; islice < slice_num; ++islice)
+    {
+        const int start_x = slice_start_point[islice * 2];
+        const int start_y = slice_start_point[islice * 2 + 1];
+
+        // columns of the slice that fall inside the image, the rest is padding like the cuda path
+        const int x0 = std::max(0, -start_x);
+        const int x1 = std::max(x0, std::min(slice_width, width - start_x));
+
+        uint8_t* pout = outs + islice * slice_size;
+        for (int y = 0; y < slice_height; ++y, pout += line_size)
+        {
+            const int dy = start_y + y;
+            if (dy < 0 || dy >= height || x1 <= x0)
+            {
+                memset(pout, const_value, line_size);
+                continue;
+            }
+
+            if (x0 > 0) memset(pout, const_value, x0 * 3);
+            copy(pout + x0 * 3, image + ((size_t)dy * width + start_x + x0) * 3, (size_t)(x1 - x0) * 3);
+            if (x1 < slice_width) memset(pout + x1 * 3, const_value, (slice_width - x1) * 3);
+        }
+    }
+}
+
+void slice_image_host(
+    const tensor::Image& image,
+    uint8_t* outs,
+    const int* slice_start_point,
+    const int slice_width,
+    const int slice_height,
+    const int slice_num,
+    const uint8_t const_value)
+{
+    // tight bgr rows are cropped in place, anything else is converted or compacted once like SliceImage does
+    const size_t line_size = (size_t)image.width * 3;
+    const uint8_t* bgr = (const uint8_t*)image.planes[0];
+    std::vector<uint8_t> converted;
+    if (image.format != tensor::PixelFormat::BGR || (size_t)image.line_size(0) != line_size)
+    {
+        converted.resize(line_size * image.height);
+        convert_to_bgr_host(image, converted.data());
+        bgr = converted.data();
+    }
+    slice_plane_host(bgr, outs, slice_start_point, image.width, image.height,
+                     slice_width, slice_height, slice_num, const_value);
+}
+
+void convert_to_bgr_host(const tensor::Image& image, uint8_t* bgr)
+{
+    const tensor::Image source = resolve_strides(image);
+    const size_t line_size = (size_t)source.width * 3;
+
+    #pragma omp parallel for schedule(static)
+    for (int y = 0; y < source.height; ++y)
+    {
+        uint8_t* pout = bgr + y * line_size;
+        for (int x = 0; x < source.width; ++x, pout += 3)
+            load_bgr(source, x, y, pout);
+    }
+}
+
+static inline float gray(const uint8_t* p)
+{
+    return 0.114f * p[0] + 0.587f * p[1] + 0.299f * p[2];
+}
+
+void slice_statistics_host(
+    const uint8_t* image,
+    const int* slice_start_point,
+    const int width,
+    const int height,
+    const int slice_width,
+    const int slice_height,
+    const int slice_num,
+    const int step,
+    float* statistics)
+{
+    #pragma omp parallel for schedule(dynamic)
+    for (int islice = 0; islice < slice_num; ++islice)
+    {
+        const int start_x = slice_start_point[islice * 2];
+        const int start_y = slice_start_point[islice * 2 + 1];
+        const int valid_w = std::min(slice_width, width - start_x);
+        const int valid_h = std::min(slice_height, height - start_y);
+
+        double sum = 0, sumsq = 0, edge = 0, count = 0;
+        for (int y = 0; y < valid_h; y += step)
+        {
+            const uint8_t* prow = image + ((size_t)(start_y + y) * width + start_x) * 3;
+            for (int x = 0; x < valid_w; x += step)
+            {
+                const uint8_t* p = prow + x * 3;
+                float g = gray(p);
+                sum   += g;
+                sumsq += g * g;
+                count += 1;
+                if (x + step < valid_w) edge += std::abs(gray(p + step * 3) - g);
+                if (y + step < valid_h) edge += std::abs(gray(p + (size_t)step * width * 3) - g);
+            }
+        }
+        float* pstat = statistics + islice * NUM_SLICE_STATISTICS;
+        pstat[0] = sum;
+        pstat[1] = sumsq;
+        pstat[2] = edge;
+        pstat[3] = count;
+    }
+}
+
+void slice_difference_host(
+    const uint8_t* image,
+    const uint8_t* previous,
+    const int* slice_start_point,
+    const int width,
+    const int height,
+    const int slice_width,
+    const int slice_height,
+    const int slice_num,
+    const int step,
+    float* difference)
+{
+    #pragma omp parallel for schedule(dynamic)
+    for (int islice = 0; islice < slice_num; ++islice)
+    {
+        const int start_x = slice_start_point[islice * 2];
+        const int start_y = slice_start_point[islice * 2 + 1];
+        const int valid_w = std::min(slice_width, width - start_x);
+        const int valid_h = std::min(slice_height, height - start_y);
+
+        double sum = 0, count = 0;
+        for (int y = 0; y < valid_h; y += step)
+        {
+            size_t offset = ((size_t)(start_y + y) * width + start_x) * 3;
+            for (int x = 0; x < valid_w; x += step, offset += step * 3)
+            {
+                sum   += std::abs(gray(image + offset) - gray(previous + offset));
+                count += 1;
+            }
+        }
+        difference[islice * 2]     = sum;
+        difference[islice * 2 + 1] = count;
+    }
+}
+
+bool keep_slice(const SliceFilter& filter, int islice, const float* statistics)
+{
+    if (islice < (int)filter.mask.size() && filter.mask[islice] == 0) return false;
+
+    float count = std::max(statistics[3], 1.0f);
+    float mean  = statistics[0] / count;
+    if (filter.type == FilterType::Variance)
+        return statistics[1] / count - mean * mean >= filter.threshold;
+    if (filter.type == FilterType::EdgeEnergy)
+        return statistics[2] / count >= filter.threshold;
+    return true;
+}
+
+}
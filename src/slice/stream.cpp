@@ -0,0 +1,143 @@
+#include "slice/stream.hpp"
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace slice
+{
+
+MappedImageSource::MappedImageSource(const std::string& file, int width, int height, size_t offset)
+    : offset_(offset), width_(width), height_(height)
+{
+    if (!map(file)) return;
+    if (width_ <= 0 || height_ <= 0 || offset_ + (size_t)width_ * height_ * 3 > size_)
+    {
+        printf("%s is smaller than a %d x %d BGR image\n", file.c_str(), width_, height_);
+        unmap();
+    }
+}
+
+MappedImageSource::MappedImageSource(const std::string& file)
+{
+    if (!map(file)) return;
+    if (!parse_ppm_header() || offset_ + (size_t)width_ * height_ * 3 > size_)
+    {
+        printf("%s is not a binary 8 bit PPM\n", file.c_str());
+        unmap();
+        return;
+    }
+    rgb_ = true;
+}
+
+MappedImageSource::~MappedImageSource()
+{
+    unmap();
+}
+
+bool MappedImageSource::map(const std::string& file)
+{
+    int fd = open(file.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        printf("Failed to open %s\n", file.c_str());
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        printf("Failed to map %s\n", file.c_str());
+        return false;
+    }
+
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+    data_ = (const uint8_t*)data;
+    size_ = st.st_size;
+    return true;
+}
+
+void MappedImageSource::unmap()
+{
+    if (data_ != nullptr) munmap((void*)data_, size_);
+    data_ = nullptr;
+    size_ = 0;
+}
+
+// P6 <whitespace> width <whitespace> height <whitespace> 255 <one whitespace> pixels, comments start with #
+bool MappedImageSource::parse_ppm_header()
+{
+    size_t pos = 0;
+    auto skip = [&]() {
+        while (pos < size_)
+        {
+            if (data_[pos] == '#')
+                while (pos < size_ && data_[pos] != '\n') ++pos;
+            else if (isspace(data_[pos]))
+                ++pos;
+            else
+                break;
+        }
+    };
+    auto number = [&](int& value) {
+        skip();
+        if (pos >= size_ || !isdigit(data_[pos])) return false;
+        value = 0;
+        while (pos < size_ && isdigit(data_[pos]) && value < (1 << 24)) value = value * 10 + (data_[pos++] - '0');
+        return true;
+    };
+
+    if (size_ < 2 || data_[0] != 'P' || data_[1] != '6') return false;
+    pos = 2;
+
+    int maxval = 0;
+    if (!number(width_) || !number(height_) || !number(maxval) || maxval != 255) return false;
+    if (pos >= size_ || !isspace(data_[pos])) return false;
+    offset_ = pos + 1;
+    return width_ > 0 && height_ > 0;
+}
+
+bool MappedImageSource::read(int y, int rows, uint8_t* dst)
+{
+    if (data_ == nullptr || y < 0 || rows < 0 || y + rows > height_) return false;
+
+    size_t line_size = (size_t)width_ * 3;
+    const uint8_t* src = data_ + offset_ + y * line_size;
+    if (!rgb_)
+    {
+        memcpy(dst, src, rows * line_size);
+    }
+    else
+    {
+        size_t num = rows * (size_t)width_;
+        for (size_t i = 0; i < num; ++i, src += 3, dst += 3)
+        {
+            dst[0] = src[2];
+            dst[1] = src[1];
+            dst[2] = src[0];
+        }
+    }
+
+    // bands only move down, the pages before this one are not needed again
+    size_t page  = sysconf(_SC_PAGESIZE);
+    size_t until = (offset_ + y * line_size) / page * page;
+    if (until > released_)
+    {
+        madvise((void*)(data_ + released_), until - released_, MADV_DONTNEED);
+        released_ = until;
+    }
+    return true;
+}
+
+}
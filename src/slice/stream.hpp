@@ -0,0 +1,82 @@
+#ifndef STREAM_HPP__
+#define STREAM_HPP__
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <string>
+
+namespace slice
+{
+
+// an image too large to hold in memory, read in horizontal bands of packed BGR rows
+class BandSource
+{
+public:
+    virtual ~BandSource() = default;
+
+    virtual int width() const = 0;
+    virtual int height() const = 0;
+
+    // rows [y, y + rows) into dst, width() * 3 bytes per row
+    virtual bool read(int y, int rows, uint8_t* dst) = 0;
+};
+
+// raw BGR file or binary PPM (P6, maxval 255) mapped into memory.
+// pages behind the last band read are handed back to the kernel, so resident memory stays at a few bands
+class MappedImageSource : public BandSource
+{
+public:
+    // raw: width x height packed BGR rows starting at offset
+    MappedImageSource(const std::string& file, int width, int height, size_t offset = 0);
+
+    // ppm: geometry from the header
+    explicit MappedImageSource(const std::string& file);
+
+    virtual ~MappedImageSource();
+
+    MappedImageSource(const MappedImageSource&) = delete;
+    MappedImageSource& operator=(const MappedImageSource&) = delete;
+
+    inline bool valid() const { return data_ != nullptr; }
+
+    virtual int width() const override { return width_; }
+    virtual int height() const override { return height_; }
+    virtual bool read(int y, int rows, uint8_t* dst) override;
+
+private:
+    bool map(const std::string& file);
+    bool parse_ppm_header();
+    void unmap();
+
+    const uint8_t* data_ = nullptr;
+    size_t size_   = 0;
+    size_t offset_ = 0;
+    size_t released_ = 0;  // bytes from the start of the mapping already handed back
+    int width_  = 0;
+    int height_ = 0;
+    bool rgb_   = false;
+};
+
+// rows come from the caller, for formats (tiled tiff, remote storage, ...) this repo does not parse
+class CallbackSource : public BandSource
+{
+public:
+    typedef std::function<bool(int y, int rows, uint8_t* dst)> ReadFunction;
+
+    CallbackSource(int width, int height, ReadFunction read)
+        : width_(width), height_(height), read_(std::move(read)) {}
+
+    virtual int width() const override { return width_; }
+    virtual int height() const override { return height_; }
+    virtual bool read(int y, int rows, uint8_t* dst) override { return read_ && read_(y, rows, dst); }
+
+private:
+    int width_;
+    int height_;
+    ReadFunction read_;
+};
+
+}
+
+#endif
@@ -2,6 +2,13 @@
 #include "common/timer.hpp"
 #include "common/image.hpp"
 #include "common/position.hpp"
+#include "model/affine.hpp"
+#include "model/sampling.hpp"
+#include <omp.h>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <vector>
 
 
 void SpeedTest()
@@ -22,4 +29,89 @@ void SpeedTest()
         auto objs = yolo->forward(tensor::cvimg(image), image.cols, image.rows, 0.0f, 0.0f);
     }
     tm.stop();
-}
\ No newline at end of file
+}
+// per pixel cost of the host warp: runtime norm branches, specialized scalar rows, specialized AVX2 rows.
+// one thread for the per pixel numbers, all threads for the last line
+void AffineHostSpeedTest()
+{
+    const int image_width = 1920, image_height = 1080, dst_width = 640, dst_height = 640, repeat = 20;
+    std::vector<uint8_t> image((size_t)image_width * image_height * 3);
+    for (size_t i = 0; i < image.size(); ++i) image[i] = (uint8_t)(i * 2654435761u >> 24);
+    std::vector<float> dst((size_t)dst_width * dst_height * 3);
+
+    affine::Norm norm = affine::Norm::alpha_beta(1 / 255.0f, 0.0f, affine::ChannelType::SwapRB);
+    affine::LetterBoxMatrix letterbox;
+    letterbox.compute(std::make_tuple(image_width, image_height), std::make_tuple(dst_width, dst_height));
+    affine::WarpTile tile;
+    tile.src           = image.data();
+    tile.src_line_size = image_width * 3;
+    tile.src_width     = image_width;
+    tile.src_height    = image_height;
+    memcpy(tile.matrix, letterbox.d2i, sizeof(tile.matrix));
+
+    auto measure = [&](const char *name, const std::function<void()> &run)
+    {
+        run();
+        auto begin = std::chrono::steady_clock::now();
+        for (int i = 0; i < repeat; ++i) run();
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count() / repeat;
+        printf("%-28s %8.3f ms  %6.2f ns/pixel\n", name, ms, ms * 1e6 / (dst_width * dst_height));
+    };
+
+    int num_threads = omp_get_max_threads();
+    omp_set_num_threads(1);
+    measure("runtime branches", [&]() {
+        affine::warp_affine_bilinear_and_normalize_plane_reference(tile.src, tile.src_line_size, tile.src_width,
+                                                                   tile.src_height, dst.data(), dst_width, dst_height,
+                                                                   tile.matrix, 114, norm);
+    });
+    affine::WarpBatchHostFn scalar = affine::select_warp_host(norm, affine::OutputType::Float32,
+                                                              affine::OutputLayout::Planar, false);
+    affine::WarpBatchHostFn vectorized = affine::select_warp_host(norm);
+    measure("specialized scalar", [&]() { scalar(&tile, 1, dst.data(), dst_width, dst_height, 114, norm); });
+    measure("specialized avx2", [&]() { vectorized(&tile, 1, dst.data(), dst_width, dst_height, 114, norm); });
+    omp_set_num_threads(num_threads);
+    measure("specialized avx2, all cores", [&]() { vectorized(&tile, 1, dst.data(), dst_width, dst_height, 114, norm); });
+}
+
+// sampling tables against the per pixel coordinate math, one thread, fixed letterbox geometry
+void SamplingTableSpeedTest()
+{
+    const int image_width = 1920, image_height = 1080, dst_width = 640, dst_height = 640, repeat = 20;
+    std::vector<uint8_t> image((size_t)image_width * image_height * 3);
+    for (size_t i = 0; i < image.size(); ++i) image[i] = (uint8_t)(i * 2654435761u >> 24);
+    std::vector<float> dst((size_t)dst_width * dst_height * 3);
+
+    affine::Norm norm = affine::Norm::alpha_beta(1 / 255.0f, 0.0f, affine::ChannelType::SwapRB);
+    affine::LetterBoxMatrix letterbox;
+    letterbox.compute(std::make_tuple(image_width, image_height), std::make_tuple(dst_width, dst_height));
+    affine::WarpTile tile;
+    tile.src           = image.data();
+    tile.src_line_size = image_width * 3;
+    tile.src_width     = image_width;
+    tile.src_height    = image_height;
+    memcpy(tile.matrix, letterbox.d2i, sizeof(tile.matrix));
+
+    auto measure = [&](const char *name, const std::function<void()> &run)
+    {
+        run();
+        auto begin = std::chrono::steady_clock::now();
+        for (int i = 0; i < repeat; ++i) run();
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count() / repeat;
+        printf("%-28s %8.3f ms  %6.2f ns/pixel\n", name, ms, ms * 1e6 / (dst_width * dst_height));
+    };
+
+    int num_threads = omp_get_max_threads();
+    omp_set_num_threads(1);
+    affine::WarpBatchHostFn scalar = affine::select_warp_host(norm, affine::OutputType::Float32,
+                                                              affine::OutputLayout::Planar, false);
+    measure("per pixel coordinates", [&]() { scalar(&tile, 1, dst.data(), dst_width, dst_height, 114, norm); });
+
+    affine::SamplingTableCache tables;
+    affine::WarpTableHostFn warp_table = affine::select_warp_table_host(norm);
+    measure("sampling tables", [&]() {
+        auto table = tables.get(image_width, image_height, dst_width, dst_height, letterbox.d2i);
+        warp_table(*table, image.data(), image_width * 3, dst.data(), 114, norm);
+    });
+    omp_set_num_threads(num_threads);
+}
@@ -0,0 +1,268 @@
+#include "model/affine.hpp"
+#include "model/sampling.hpp"
+#include "common/memory.hpp"
+#include "common/check.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <tuple>
+#include <vector>
+
+// batched warp on the gpu against the host reference, and against one launch per tile
+void AffineTest()
+{
+    const int dst_width = 640, dst_height = 640, num_tiles = 6;
+    const int image_width = 1920, image_height = 1080;
+    affine::Norm norm = affine::Norm::alpha_beta(1 / 255.0f, 0.0f, affine::ChannelType::SwapRB);
+
+    tensor::Memory<uint8_t> image;
+    uint8_t *image_host = image.cpu(image_width * image_height * 3);
+    srand(17);
+    for (int i = 0; i < image_width * image_height * 3; ++i) image_host[i] = rand() % 256;
+    checkRuntime(cudaMemcpy(image.gpu(image_width * image_height * 3), image_host, image.cpu_bytes(), cudaMemcpyHostToDevice));
+
+    // tiles of different sizes and positions, the last one runs past the image border
+    tensor::Memory<affine::WarpTile> tiles;
+    affine::WarpTile *host_tiles = tiles.cpu(num_tiles);
+    std::vector<affine::WarpTile> device_tiles(num_tiles);
+    for (int i = 0; i < num_tiles; ++i)
+    {
+        int x = i * 300, y = (i % 2) * 400;
+        int w = 400 + i * 60, h = 500 + i * 30;
+        w = std::min(w, image_width - x);
+        h = std::min(h, image_height - y);
+
+        affine::LetterBoxMatrix letterbox;
+        letterbox.compute(std::make_tuple(w, h), std::make_tuple(dst_width, dst_height));
+
+        affine::WarpTile tile;
+        tile.src_line_size = image_width * 3;
+        tile.src_width     = w;
+        tile.src_height    = h;
+        memcpy(tile.matrix, letterbox.d2i, sizeof(tile.matrix));
+
+        tile.src = image_host + ((size_t)y * image_width + x) * 3;
+        host_tiles[i] = tile;
+        tile.src = image.gpu() + ((size_t)y * image_width + x) * 3;
+        device_tiles[i] = tile;
+    }
+
+    size_t numel = (size_t)num_tiles * dst_width * dst_height * 3;
+    std::vector<float> reference(numel);
+    affine::warp_affine_bilinear_and_normalize_plane_batch_host(host_tiles, num_tiles, reference.data(),
+                                                                dst_width, dst_height, 114, norm);
+
+    memcpy(host_tiles, device_tiles.data(), num_tiles * sizeof(affine::WarpTile));
+    checkRuntime(cudaMemcpy(tiles.gpu(num_tiles), host_tiles, num_tiles * sizeof(affine::WarpTile), cudaMemcpyHostToDevice));
+
+    tensor::Memory<float> batched, single, matrix;
+    batched.gpu(numel);
+    single.gpu(numel);
+    matrix.gpu(num_tiles * 6);
+    affine::warp_affine_bilinear_and_normalize_plane_batch(tiles.gpu(), num_tiles, batched.gpu(),
+                                                           dst_width, dst_height, 114, norm, nullptr);
+    for (int i = 0; i < num_tiles; ++i)
+    {
+        checkRuntime(cudaMemcpy(matrix.gpu() + i * 6, device_tiles[i].matrix, 6 * sizeof(float), cudaMemcpyHostToDevice));
+        affine::warp_affine_bilinear_and_normalize_plane((uint8_t *)device_tiles[i].src, device_tiles[i].src_line_size,
+                                                         device_tiles[i].src_width, device_tiles[i].src_height,
+                                                         single.gpu() + (size_t)i * dst_width * dst_height * 3,
+                                                         dst_width, dst_height, matrix.gpu() + i * 6, 114, norm, nullptr);
+    }
+
+    std::vector<float> batched_host(numel), single_host(numel);
+    checkRuntime(cudaMemcpy(batched_host.data(), batched.gpu(), numel * sizeof(float), cudaMemcpyDeviceToHost));
+    checkRuntime(cudaMemcpy(single_host.data(), single.gpu(), numel * sizeof(float), cudaMemcpyDeviceToHost));
+
+    // one step of the 8 bit input is 1 / 255 after normalization, fma contraction may move a rounding by one step
+    float max_reference = 0, max_single = 0;
+    for (size_t i = 0; i < numel; ++i)
+    {
+        max_reference = std::max(max_reference, std::fabs(batched_host[i] - reference[i]));
+        max_single    = std::max(max_single, std::fabs(batched_host[i] - single_host[i]));
+    }
+    printf("batched warp vs host reference: max diff %f, vs per tile launches: max diff %f\n", max_reference, max_single);
+    printf("%s\n", max_reference <= 1.0f / 255.0f + 1e-6f && max_single == 0 ? "AffineTest passed" : "AffineTest FAILED");
+}
+
+// host warp (avx2 + openmp) against the scalar reference, runs without a gpu
+void AffineHostTest()
+{
+    const int image_width = 1283, image_height = 721;
+    std::vector<uint8_t> image((size_t)image_width * image_height * 3);
+    srand(23);
+    for (size_t i = 0; i < image.size(); ++i) image[i] = rand() % 256;
+
+    const float mean[3] = {0.485f, 0.456f, 0.406f};
+    const float std[3]  = {0.229f, 0.224f, 0.225f};
+    affine::Norm norms[] = {affine::Norm::alpha_beta(1 / 255.0f, 0.0f, affine::ChannelType::SwapRB),
+                            affine::Norm::mean_std(mean, std, 1 / 255.0f, affine::ChannelType::SwapRB),
+                            affine::Norm::mean_std(mean, std),
+                            affine::Norm::None()};
+
+    // letterbox, plain downscale, upscale past the border and an odd output width for the scalar tail
+    std::tuple<int, int> sizes[] = {std::make_tuple(640, 640), std::make_tuple(320, 180),
+                                    std::make_tuple(1603, 997), std::make_tuple(333, 211)};
+
+    // float to fp16 rounding: exact, ties to even, overflow, subnormals
+    const std::tuple<float, uint16_t> halves[] = {
+        std::make_tuple(1.0f, 0x3C00), std::make_tuple(-2.0f, 0xC000), std::make_tuple(0.1f, 0x2E66),
+        std::make_tuple(65504.0f, 0x7BFF), std::make_tuple(65520.0f, 0x7C00), std::make_tuple(2049.0f, 0x6800),
+        std::make_tuple(2051.0f, 0x6802), std::make_tuple(5.9604645e-8f, 0x0001), std::make_tuple(2.9802322e-8f, 0x0000),
+        std::make_tuple(6.1035156e-5f, 0x0400)};
+    bool passed = true;
+    for (const auto &item : halves)
+    {
+        uint16_t bits = affine::float_to_half_bits(std::get<0>(item));
+        if (bits != std::get<1>(item) || affine::float_to_half_bits(affine::half_bits_to_float(bits)) != bits)
+        {
+            printf("fp16 of %g is 0x%04x, expected 0x%04x\n", std::get<0>(item), bits, std::get<1>(item));
+            passed = false;
+        }
+    }
+
+    for (const affine::Norm &norm : norms)
+    {
+        // 1 LSB of the 8 bit input after normalization
+        float lsb = norm.type == affine::NormType::None ? 1.0f : norm.alpha;
+        if (norm.type == affine::NormType::MeanStd) lsb /= *std::min_element(norm.std, norm.std + 3);
+
+        for (const auto &size : sizes)
+        {
+            int dst_width = std::get<0>(size), dst_height = std::get<1>(size);
+            affine::LetterBoxMatrix letterbox;
+            letterbox.compute(std::make_tuple(image_width, image_height), size);
+
+            size_t numel = (size_t)dst_width * dst_height * 3;
+            std::vector<float> reference(numel), host(numel);
+            affine::warp_affine_bilinear_and_normalize_plane_reference(image.data(), image_width * 3, image_width, image_height,
+                                                                       reference.data(), dst_width, dst_height,
+                                                                       letterbox.d2i, 114, norm);
+            affine::warp_affine_bilinear_and_normalize_plane_host(image.data(), image_width * 3, image_width, image_height,
+                                                                  host.data(), dst_width, dst_height,
+                                                                  letterbox.d2i, 114, norm);
+            float max_diff = 0;
+            for (size_t i = 0; i < numel; ++i) max_diff = std::max(max_diff, std::fabs(host[i] - reference[i]));
+            passed = passed && max_diff <= lsb * 1.001f;
+            printf("host warp %dx%d norm %d: max diff %f (1 lsb %f)\n", dst_width, dst_height, (int)norm.type, max_diff, lsb);
+        }
+
+        // precomputed sampling tables give the bits of the per pixel warp
+        {
+            affine::SamplingTableCache tables(2);
+            int dst_width = 333, dst_height = 211;
+            affine::LetterBoxMatrix letterbox;
+            letterbox.compute(std::make_tuple(image_width, image_height), std::make_tuple(dst_width, dst_height));
+
+            size_t numel = (size_t)dst_width * dst_height * 3;
+            std::vector<float> reference(numel), table_output(numel);
+            affine::warp_affine_bilinear_and_normalize_plane_reference(image.data(), image_width * 3, image_width, image_height,
+                                                                       reference.data(), dst_width, dst_height,
+                                                                       letterbox.d2i, 114, norm);
+            auto table = tables.get(image_width, image_height, dst_width, dst_height, letterbox.d2i);
+            bool reused = table && tables.get(image_width, image_height, dst_width, dst_height, letterbox.d2i) == table;
+            if (table)
+                affine::select_warp_table_host(norm)(*table, image.data(), image_width * 3, table_output.data(), 114, norm);
+            size_t table_mismatch = 0;
+            for (size_t i = 0; i < numel; ++i) table_mismatch += table_output[i] != reference[i];
+
+            // a rotation is not separable and has no table
+            const float rotation[6] = {0.8f, -0.6f, 100.0f, 0.6f, 0.8f, 50.0f};
+            bool rejected = tables.get(image_width, image_height, dst_width, dst_height, rotation) == nullptr;
+            passed = passed && reused && rejected && table_mismatch == 0;
+            printf("host table warp norm %d: %zu mismatches, cached %d, rotation rejected %d\n", (int)norm.type,
+                   table_mismatch, (int)reused, (int)rejected);
+        }
+
+        // a batch of crops, each checked against the reference of its own slot
+        const int dst_width = 320, dst_height = 320, num_tiles = 5;
+        std::vector<affine::WarpTile> tiles(num_tiles);
+        for (int i = 0; i < num_tiles; ++i)
+        {
+            int x = i * 250, y = (i % 2) * 300;
+            int w = std::min(300 + i * 40, image_width - x);
+            int h = std::min(350 + i * 20, image_height - y);
+            affine::LetterBoxMatrix tile_letterbox;
+            tile_letterbox.compute(std::make_tuple(w, h), std::make_tuple(dst_width, dst_height));
+
+            tiles[i].src = image.data() + ((size_t)y * image_width + x) * 3;
+            tiles[i].src_line_size = image_width * 3;
+            tiles[i].src_width     = w;
+            tiles[i].src_height    = h;
+            memcpy(tiles[i].matrix, tile_letterbox.d2i, sizeof(tiles[i].matrix));
+        }
+
+        size_t slot = (size_t)dst_width * dst_height * 3;
+        std::vector<float> batched(slot * num_tiles), reference(slot);
+        affine::warp_affine_bilinear_and_normalize_plane_batch_host(tiles.data(), num_tiles, batched.data(),
+                                                                    dst_width, dst_height, 114, norm);
+        float max_diff = 0;
+        for (int i = 0; i < num_tiles; ++i)
+        {
+            affine::warp_affine_bilinear_and_normalize_plane_reference(tiles[i].src, tiles[i].src_line_size,
+                                                                       tiles[i].src_width, tiles[i].src_height,
+                                                                       reference.data(), dst_width, dst_height,
+                                                                       tiles[i].matrix, 114, norm);
+            for (size_t j = 0; j < slot; ++j)
+                max_diff = std::max(max_diff, std::fabs(batched[i * slot + j] - reference[j]));
+        }
+        passed = passed && max_diff <= lsb * 1.001f;
+        printf("host batch warp norm %d: max diff %f (1 lsb %f)\n", (int)norm.type, max_diff, lsb);
+
+        // scalar specialization and the packed layout hold the same values as the planar reference
+        std::vector<float> scalar(slot * num_tiles), packed(slot * num_tiles);
+        affine::select_warp_host(norm, affine::OutputType::Float32, affine::OutputLayout::Planar, false)(
+            tiles.data(), num_tiles, scalar.data(), dst_width, dst_height, 114, norm);
+        affine::select_warp_host(norm, affine::OutputType::Float32, affine::OutputLayout::Packed)(
+            tiles.data(), num_tiles, packed.data(), dst_width, dst_height, 114, norm);
+        max_diff = 0;
+        const int area = dst_width * dst_height;
+        for (int i = 0; i < num_tiles; ++i)
+        {
+            for (int p = 0; p < area; ++p)
+            {
+                for (int c = 0; c < 3; ++c)
+                {
+                    float planar = batched[i * slot + c * area + p];
+                    max_diff = std::max(max_diff, std::fabs(scalar[i * slot + c * area + p] - planar));
+                    max_diff = std::max(max_diff, std::fabs(packed[i * slot + p * 3 + c] - planar));
+                }
+            }
+        }
+        passed = passed && max_diff <= lsb * 1.001f;
+        printf("host scalar and packed warp norm %d: max diff %f (1 lsb %f)\n", (int)norm.type, max_diff, lsb);
+
+        // fp16 input, vectorized and scalar, has the bits of the rounded float reference
+        std::vector<affine::Half> half_vectorized(slot * num_tiles), half_scalar(slot * num_tiles);
+        affine::select_warp_host(norm, affine::OutputType::Float16)(
+            tiles.data(), num_tiles, half_vectorized.data(), dst_width, dst_height, 114, norm);
+        affine::select_warp_host(norm, affine::OutputType::Float16, affine::OutputLayout::Planar, false)(
+            tiles.data(), num_tiles, half_scalar.data(), dst_width, dst_height, 114, norm);
+        size_t half_mismatch = 0;
+        for (size_t i = 0; i < slot * num_tiles; ++i)
+        {
+            uint16_t expect = affine::float_to_half_bits(batched[i]);
+            half_mismatch += half_vectorized[i].bits != expect || half_scalar[i].bits != expect;
+        }
+        passed = passed && half_mismatch == 0;
+        printf("host fp16 warp norm %d: %zu mismatches\n", (int)norm.type, half_mismatch);
+
+        // uint8 nhwc input for engines that normalize in the graph, a resize only warp
+        if (norm.type == affine::NormType::None && norm.channel_type == affine::ChannelType::None)
+        {
+            std::vector<uint8_t> bytes(slot * num_tiles);
+            affine::select_warp_host(norm, affine::OutputType::UInt8, affine::OutputLayout::Packed)(
+                tiles.data(), num_tiles, bytes.data(), dst_width, dst_height, 114, norm);
+            size_t byte_mismatch = 0;
+            for (int i = 0; i < num_tiles; ++i)
+                for (int p = 0; p < area; ++p)
+                    for (int c = 0; c < 3; ++c)
+                        byte_mismatch += bytes[i * slot + p * 3 + c] != batched[i * slot + c * area + p];
+            passed = passed && byte_mismatch == 0;
+            printf("host uint8 nhwc warp: %zu mismatches\n", byte_mismatch);
+        }
+    }
+    printf("%s\n", passed ? "AffineHostTest passed" : "AffineHostTest FAILED");
+}
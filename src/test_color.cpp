@@ -0,0 +1,89 @@
+#include "slice/color.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// largest per byte difference of the host conversion of image to the bgr frame expect
+static int max_difference(const tensor::Image &image, const uint8_t *expect)
+{
+    std::vector<uint8_t> bgr((size_t)image.width * image.height * 3);
+    slice::convert_to_bgr_host(image, bgr.data());
+    int diff = 0;
+    for (size_t i = 0; i < bgr.size(); ++i) diff = std::max(diff, std::abs((int)bgr[i] - (int)expect[i]));
+    return diff;
+}
+
+// host color conversion against opencv's cvtColor, with padded rows to exercise the strides
+void ColorTest()
+{
+    const int width = 642, height = 362, pad = 17;
+    const int chroma_width = width / 2, chroma_height = height / 2;
+    srand(31);
+
+    // planes with padding, and the same bytes tightly packed the way cvtColor wants them
+    int y_stride = width + pad, uv_stride = chroma_width * 2 + pad, c_stride = chroma_width + pad;
+    std::vector<uint8_t> luma((size_t)y_stride * height), uv((size_t)uv_stride * chroma_height);
+    std::vector<uint8_t> u((size_t)c_stride * chroma_height), v((size_t)c_stride * chroma_height);
+    for (auto &p : luma) p = rand() % 256;
+    for (int y = 0; y < chroma_height; ++y)
+    {
+        for (int x = 0; x < chroma_width; ++x)
+        {
+            u[y * c_stride + x] = uv[y * uv_stride + x * 2]     = rand() % 256;
+            v[y * c_stride + x] = uv[y * uv_stride + x * 2 + 1] = rand() % 256;
+        }
+    }
+
+    cv::Mat nv12(height * 3 / 2, width, CV_8UC1), i420(height * 3 / 2, width, CV_8UC1);
+    for (int y = 0; y < height; ++y)
+    {
+        memcpy(nv12.ptr(y), luma.data() + y * y_stride, width);
+        memcpy(i420.ptr(y), luma.data() + y * y_stride, width);
+    }
+    uint8_t *nv12_uv = nv12.ptr(height);
+    uint8_t *i420_u = i420.ptr(height), *i420_v = i420_u + chroma_width * chroma_height;
+    for (int y = 0; y < chroma_height; ++y)
+    {
+        memcpy(nv12_uv + y * width, uv.data() + y * uv_stride, width);
+        memcpy(i420_u + y * chroma_width, u.data() + y * c_stride, chroma_width);
+        memcpy(i420_v + y * chroma_width, v.data() + y * c_stride, chroma_width);
+    }
+
+    cv::Mat expect_nv12, expect_i420;
+    cv::cvtColor(nv12, expect_nv12, cv::COLOR_YUV2BGR_NV12);
+    cv::cvtColor(i420, expect_i420, cv::COLOR_YUV2BGR_I420);
+
+    // the fixed point math is opencv's, ipp builds of opencv may still round a byte differently
+    int diff_nv12 = max_difference(tensor::Image::nv12(luma.data(), y_stride, uv.data(), uv_stride, width, height),
+                                   expect_nv12.data);
+    int diff_i420 = max_difference(tensor::Image::i420(luma.data(), y_stride, u.data(), c_stride, v.data(), c_stride,
+                                                       width, height), expect_i420.data);
+
+    // packed formats are exact
+    cv::Mat bgr = expect_nv12, rgb, bgra, gray, expect_gray;
+    cv::cvtColor(bgr, rgb, cv::COLOR_BGR2RGB);
+    cv::cvtColor(bgr, bgra, cv::COLOR_BGR2BGRA);
+    cv::cvtColor(bgr, gray, cv::COLOR_BGR2GRAY);
+    cv::cvtColor(gray, expect_gray, cv::COLOR_GRAY2BGR);
+    int diff_rgb  = max_difference(tensor::Image(rgb.data, width, height, tensor::PixelFormat::RGB), bgr.data);
+    int diff_bgra = max_difference(tensor::Image(bgra.data, width, height, tensor::PixelFormat::BGRA), bgr.data);
+    int diff_gray = max_difference(tensor::Image(gray.data, width, height, tensor::PixelFormat::GRAY), expect_gray.data);
+
+    // a roi view keeps the step of its parent through cvimg
+    cv::Mat roi = bgr(cv::Rect(13, 7, 301, 200)), roi_copy = roi.clone();
+    int diff_roi = max_difference(tensor::cvimg(roi), roi_copy.data);
+
+    // black and white of the video range
+    uint8_t levels[] = {16, 235}, chroma[] = {128, 128}, extremes[6];
+    slice::convert_to_bgr_host(tensor::Image::nv12(levels, 2, chroma, 2, 2, 1), extremes);
+    bool range = extremes[0] == 0 && extremes[1] == 0 && extremes[2] == 0 &&
+                 extremes[3] == 255 && extremes[4] == 255 && extremes[5] == 255;
+
+    printf("nv12 max diff %d, i420 max diff %d, rgb %d, bgra %d, gray %d, roi %d, video range %d\n",
+           diff_nv12, diff_i420, diff_rgb, diff_bgra, diff_gray, diff_roi, (int)range);
+    bool passed = diff_nv12 <= 1 && diff_i420 <= 1 && diff_rgb == 0 && diff_bgra == 0 && diff_gray == 0 &&
+                  diff_roi == 0 && range;
+    printf("%s\n", passed ? "ColorTest passed" : "ColorTest FAILED");
+}
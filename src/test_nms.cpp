@@ -0,0 +1,147 @@
+#include "model/nms.hpp"
+#include "common/check.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <numeric>
+#include <vector>
+
+static const int ELEMENT = 9;
+
+// dense clusters of overlapping boxes over a few classes, confidences on a coarse grid so that many are equal
+static std::vector<float> make_rows(int count, int num_classes, unsigned seed)
+{
+    srand(seed);
+    std::vector<float> rows((size_t)count * ELEMENT, 0.0f);
+    int num_clusters = std::max(count / 40, 1);
+    for (int i = 0; i < count; ++i)
+    {
+        int cluster = rand() % num_clusters;
+        float cx = (cluster * 97) % 3840 + (rand() % 41 - 20);
+        float cy = (cluster * 53) % 2160 + (rand() % 41 - 20);
+        float w  = 20 + rand() % 80 + (rand() % 100) / 100.0f;
+        float h  = 20 + rand() % 80 + (rand() % 100) / 100.0f;
+        float *p = rows.data() + (size_t)i * ELEMENT;
+        p[0] = cx - w * 0.5f;
+        p[1] = cy - h * 0.5f;
+        p[2] = cx + w * 0.5f;
+        p[3] = cy + h * 0.5f;
+        p[4] = 0.25f + (rand() % 48) / 64.0f;
+        p[5] = (cluster + rand() % 2) % num_classes;
+        p[6] = 1;
+        p[7] = i;
+    }
+    return rows;
+}
+
+// the mask and reduce kernels of nms_rows step by step on the host
+static std::vector<float> bitmask_keepflags(std::vector<float> rows, int count, float threshold)
+{
+    std::vector<int> order(count);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+        return rows[a * ELEMENT + nms::NMS_CONFIDENCE] > rows[b * ELEMENT + nms::NMS_CONFIDENCE];
+    });
+
+    int col_blocks = (count + nms::NMS_BLOCK - 1) / nms::NMS_BLOCK;
+    std::vector<unsigned long long> mask((size_t)count * col_blocks, 0);
+    for (int i = 0; i < count; ++i)
+    {
+        const float *a = rows.data() + order[i] * ELEMENT;
+        for (int j = i + 1; j < count; ++j)
+        {
+            const float *b = rows.data() + order[j] * ELEMENT;
+            if (nms::suppresses(a, a[nms::NMS_LABEL], b, b[nms::NMS_LABEL], threshold))
+                mask[(size_t)i * col_blocks + j / nms::NMS_BLOCK] |= 1ULL << (j % nms::NMS_BLOCK);
+        }
+    }
+
+    std::vector<unsigned long long> removed(col_blocks, 0);
+    std::vector<float> keepflags(count);
+    for (int i = 0; i < count; ++i)
+    {
+        bool keep = ((removed[i / nms::NMS_BLOCK] >> (i % nms::NMS_BLOCK)) & 1ULL) == 0;
+        keepflags[order[i]] = keep ? 1 : 0;
+        if (!keep) continue;
+        for (int w = i / nms::NMS_BLOCK; w < col_blocks; ++w) removed[w] |= mask[(size_t)i * col_blocks + w];
+    }
+    return keepflags;
+}
+
+static int count_mismatches(const std::vector<float> &rows, const std::vector<float> &keepflags, int *kept)
+{
+    int mismatches = 0;
+    *kept = 0;
+    for (size_t i = 0; i < keepflags.size(); ++i)
+    {
+        float flag = rows[i * ELEMENT + nms::NMS_KEEPFLAG];
+        mismatches += flag != keepflags[i];
+        *kept += flag == 1;
+    }
+    return mismatches;
+}
+
+// host nms against the bitmask algorithm of the kernels, the iou symmetric to the bit
+void NmsHostTest()
+{
+    const float threshold = 0.45f;
+    bool passed = true;
+
+    // iou of swapped boxes, the mask compares the more confident box first and the host the kept one
+    float a[4] = {10.3f, 20.7f, 110.1f, 95.9f}, b[4] = {40.2f, 11.1f, 130.7f, 80.3f};
+    if (nms::box_iou(a, b) != nms::box_iou(b, a)) passed = false;
+
+    int sizes[] = {0, 1, 63, 64, 65, 1000, 6000};
+    for (int count : sizes)
+    {
+        std::vector<float> rows = make_rows(count, 5, 7 + count);
+        std::vector<float> expect = bitmask_keepflags(rows, count, threshold);
+        nms::nms_rows_host(rows.data(), count, ELEMENT, threshold);
+
+        int kept = 0;
+        int mismatches = count_mismatches(rows, expect, &kept);
+        printf("count %5d kept %5d mismatches %d\n", count, kept, mismatches);
+        if (mismatches != 0 || (count > 0 && kept == 0)) passed = false;
+    }
+    printf("%s\n", passed ? "NmsHostTest passed" : "NmsHostTest FAILED");
+}
+
+// cuda nms_rows against the host twin, bit for bit
+void NmsTest()
+{
+    const float threshold = 0.45f;
+    const int capacity = 16384;
+    bool passed = true;
+    nms::Workspace workspace;
+    tensor::Memory<float> rows_memory;
+    tensor::Memory<int> count_memory;
+    rows_memory.gpu((size_t)capacity * ELEMENT);
+    count_memory.gpu(1);
+    count_memory.cpu(1);
+
+    int sizes[] = {0, 1, 100, 4096, 12000, 20000};
+    for (int count : sizes)
+    {
+        std::vector<float> rows = make_rows(count, 5, 11 + count);
+        int num = std::min(count, capacity);
+        *count_memory.cpu() = count;
+        checkRuntime(cudaMemcpy(rows_memory.gpu(), rows.data(), (size_t)num * ELEMENT * sizeof(float), cudaMemcpyHostToDevice));
+        checkRuntime(cudaMemcpy(count_memory.gpu(), count_memory.cpu(), sizeof(int), cudaMemcpyHostToDevice));
+        nms::nms_rows(rows_memory.gpu(), count_memory.gpu(), capacity, ELEMENT, threshold, workspace, nullptr);
+
+        std::vector<float> device((size_t)num * ELEMENT);
+        checkRuntime(cudaMemcpy(device.data(), rows_memory.gpu(), device.size() * sizeof(float), cudaMemcpyDeviceToHost));
+
+        // rows past the capacity are dropped like the decode kernels drop them
+        rows.resize((size_t)num * ELEMENT);
+        nms::nms_rows_host(rows.data(), num, ELEMENT, threshold);
+        std::vector<float> keepflags(num);
+        for (int i = 0; i < num; ++i) keepflags[i] = device[(size_t)i * ELEMENT + nms::NMS_KEEPFLAG];
+
+        int kept = 0;
+        int mismatches = count_mismatches(rows, keepflags, &kept);
+        printf("count %5d kept %5d mismatches %d\n", count, kept, mismatches);
+        if (mismatches != 0) passed = false;
+    }
+    printf("%s\n", passed ? "NmsTest passed" : "NmsTest FAILED");
+}
@@ -0,0 +1,168 @@
+#include "slice/planner.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <vector>
+
+// smallest overlap in pixels of a tile that meets the ratio
+static int required_overlap(int tile, float ratio)
+{
+    return std::max(0, (int)std::ceil((double)ratio * tile - 1e-4));
+}
+
+// largest tile of the axis that the network does not shrink below scale_ratio
+static int largest_tile(int dimension, int network, float scale_ratio)
+{
+    int tile = scale_ratio > 0 ? (int)std::floor(network / (double)scale_ratio + 1e-6) : dimension;
+    return std::max(1, std::min(tile, dimension));
+}
+
+// the starts of one axis of the grid, checked for coverage, overlap and scale
+static bool check_axis(const std::vector<int> &starts, int dimension, int tile, int network,
+                       float overlap_ratio, float scale_ratio)
+{
+    if (starts.empty() || starts.front() != 0) return false;
+    if (starts.back() + tile < dimension) return false;
+    if (tile > 1 && tile < dimension && (double)network / tile < scale_ratio - 1e-6) return false;
+    for (size_t i = 1; i < starts.size(); ++i)
+    {
+        // neighbours leave no gap and share at least the required overlap
+        int overlap = starts[i - 1] + tile - starts[i];
+        if (starts[i] <= starts[i - 1] || overlap < required_overlap(tile, overlap_ratio)) return false;
+    }
+    return true;
+}
+
+// no tile size within the scale limit covers the axis with fewer tiles at the required overlap
+static bool is_minimal(int dimension, int num, int network, float overlap_ratio, float scale_ratio)
+{
+    if (num <= 1) return true;
+    int max_tile = largest_tile(dimension, network, scale_ratio);
+    for (int tile = 1; tile <= max_tile; ++tile)
+    {
+        int step = tile - required_overlap(tile, overlap_ratio);
+        if (step <= 0) continue;
+        if (tile + (long long)(num - 2) * step >= dimension) return false;
+    }
+    return true;
+}
+
+// the grid of the planner over a sweep of image sizes. the axes are planned independently, so the fewest
+// tiles along each axis is also the fewest tiles of the grid
+void PlannerTest()
+{
+    struct Case { int network_width, network_height; float overlap_ratio, scale_ratio; };
+    Case cases[] = {
+        {640, 640, 0.2f, 0.5f},
+        {640, 384, 0.25f, 0.8f},
+        {1024, 1024, 0.1f, 1.0f},
+        {320, 320, 0.0f, 0.25f},
+    };
+
+    std::vector<int> sizes = {1, 2, 3, 319, 320, 321, 639, 640, 641, 1079, 1080, 1279, 1280, 1281, 1920, 2160, 2561, 3840, 4097};
+    for (int size = 5; size < 4000; size += 97) sizes.push_back(size);
+
+    bool passed = true;
+    int num_grids = 0;
+    for (const Case &c : cases)
+    {
+        slice::SlicePlanner planner(c.network_width, c.network_height, c.overlap_ratio, c.scale_ratio, 4);
+        for (int width : sizes)
+        {
+            for (int height : sizes)
+            {
+                slice::SliceGrid grid = planner.plan(width, height);
+
+                // the grid is sliced through the same ratios SliceImage uses
+                int num_h = 0, num_v = 0;
+                std::vector<int> points = slice::calculateSliceStartPoints(
+                    width, height, grid.slice_width, grid.slice_height,
+                    grid.overlap_width_ratio, grid.overlap_height_ratio, num_h, num_v);
+
+                std::vector<int> xs, ys;
+                for (int i = 0; i < num_h; ++i) xs.push_back(points[i * num_v * 2]);
+                for (int j = 0; j < num_v; ++j) ys.push_back(points[j * 2 + 1]);
+
+                bool ok = num_h == grid.slice_num_h && num_v == grid.slice_num_v &&
+                          slice::overlapPixels(grid.slice_width, grid.overlap_width_ratio) == grid.overlap_width_pixel &&
+                          slice::overlapPixels(grid.slice_height, grid.overlap_height_ratio) == grid.overlap_height_pixel &&
+                          check_axis(xs, width, grid.slice_width, c.network_width, c.overlap_ratio, c.scale_ratio) &&
+                          check_axis(ys, height, grid.slice_height, c.network_height, c.overlap_ratio, c.scale_ratio) &&
+                          is_minimal(width, num_h, c.network_width, c.overlap_ratio, c.scale_ratio) &&
+                          is_minimal(height, num_v, c.network_height, c.overlap_ratio, c.scale_ratio) &&
+                          grid.rounds == (grid.slice_num() + 3) / 4;
+                if (!ok)
+                {
+                    printf("network %dx%d overlap %.2f scale %.2f image %dx%d: tile %dx%d grid %dx%d wrong\n",
+                           c.network_width, c.network_height, c.overlap_ratio, c.scale_ratio, width, height,
+                           grid.slice_width, grid.slice_height, grid.slice_num_h, grid.slice_num_v);
+                    passed = false;
+                }
+                ++num_grids;
+            }
+        }
+    }
+    printf("%d grids\n", num_grids);
+    printf("%s\n", passed ? "PlannerTest passed" : "PlannerTest FAILED");
+}
+
+// a box the slice fully contains, the slice can find it
+static bool contains(const std::vector<int> &points, int islice, int slice_width, int slice_height, const float *box)
+{
+    float x = points[islice * 2], y = points[islice * 2 + 1];
+    return box[0] >= x && box[1] >= y && box[2] <= x + slice_width && box[3] <= y + slice_height;
+}
+
+// ownsBox with some slices of the grid skipped: every box found by a seen slice is kept by one of them
+void OwnershipTest()
+{
+    const int width = 1920, height = 1080, slice_width = 640, slice_height = 640;
+    int num_h = 0, num_v = 0;
+    std::vector<int> points = slice::calculateSliceStartPoints(width, height, slice_width, slice_height, 0.25f, 0.25f, num_h, num_v);
+    std::vector<float> cores = slice::calculateSliceCores(points, num_h, num_v, slice_width, slice_height);
+    int slice_num = num_h * num_v;
+
+    srand(5);
+    std::vector<float> boxes;
+    for (int i = 0; i < 20000; ++i)
+    {
+        float w = 4 + rand() % 150, h = 4 + rand() % 150;
+        float left = rand() % (int)(width - w), top = rand() % (int)(height - h);
+        boxes.insert(boxes.end(), {left, top, left + w, top + h});
+    }
+
+    bool passed = true;
+    int lost_fixed = 0, lost_widened = 0, tested = 0;
+    for (int mask = 0; mask < (1 << slice_num); ++mask)
+    {
+        std::vector<uint8_t> seen(slice_num);
+        for (int i = 0; i < slice_num; ++i) seen[i] = (mask >> i) & 1;
+        std::vector<float> widened = slice::widenCores(cores, points, slice_width, slice_height, seen);
+
+        for (size_t ibox = 0; ibox < boxes.size(); ibox += 4)
+        {
+            const float *box = boxes.data() + ibox;
+            bool found = false, owned_fixed = false;
+            int owners = 0;
+            for (int i = 0; i < slice_num; ++i)
+            {
+                if (!seen[i] || !contains(points, i, slice_width, slice_height, box)) continue;
+                found = true;
+                owned_fixed |= slice::ownsBox(cores.data() + i * slice::NUM_CORE_ELEMENT, box[0], box[1], box[2], box[3]);
+                owners += slice::ownsBox(widened.data() + i * slice::NUM_CORE_ELEMENT, box[0], box[1], box[2], box[3]);
+            }
+            if (!found) continue;
+            ++tested;
+            lost_fixed += !owned_fixed;
+            lost_widened += owners == 0;
+
+            // with every slice seen the cores stay a partition, one owner per box
+            if (mask == (1 << slice_num) - 1 && owners != 1) passed = false;
+        }
+    }
+    if (lost_widened != 0) passed = false;
+    printf("grid %dx%d, %d boxes over all skip masks, lost with the plan cores %d, with widened cores %d\n",
+           num_h, num_v, tested, lost_fixed, lost_widened);
+    printf("%s\n", passed ? "OwnershipTest passed" : "OwnershipTest FAILED");
+}
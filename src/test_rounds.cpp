@@ -0,0 +1,124 @@
+#include "model/rounds.hpp"
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// an engine of float items in and out, output = input * 2 + 1 for the items of the batch it was set to.
+// max_batch is the kMAX of the profile of a dynamic engine or the batch of a static one
+class FakeEngine : public TensorRT::Engine
+{
+public:
+    FakeEngine(int max_batch, bool dynamic) : max_batch_(max_batch), dynamic_(dynamic), batch_(max_batch) {}
+
+    std::vector<int> batches; // batch of every forward
+
+#ifdef TRT10
+    virtual bool forward(const std::unordered_map<std::string, const void *> &bindings, void *stream = nullptr,
+                         void *input_consum_event = nullptr) override
+    {
+        return run((const float *)bindings.at("images"), (float *)bindings.at("output0"));
+    }
+    virtual bool is_input(const std::string &name) override { return name == "images"; }
+    virtual void print(const char *name = "TensorRT-Engine") override {}
+#else
+    virtual bool forward(const std::vector<void *> &bindings, void *stream = nullptr,
+                         void *input_consum_event = nullptr) override
+    {
+        return run((const float *)bindings[0], (float *)bindings[1]);
+    }
+    virtual void print() override {}
+#endif
+
+    virtual int index(const std::string &name) override { return name == "images" ? 0 : 1; }
+    virtual std::vector<int> run_dims(const std::string &name) override { return run_dims(index(name)); }
+    virtual std::vector<int> run_dims(int ibinding) override { return {batch_, 1}; }
+    virtual std::vector<int> static_dims(const std::string &name) override { return static_dims(index(name)); }
+    virtual std::vector<int> static_dims(int ibinding) override { return {dynamic_ ? -1 : max_batch_, 1}; }
+    virtual std::vector<int> max_dims(const std::string &name) override { return max_dims(index(name)); }
+    virtual std::vector<int> max_dims(int ibinding) override { return {max_batch_, 1}; }
+    virtual int numel(const std::string &name) override { return numel(index(name)); }
+    virtual int numel(int ibinding) override { return batch_; }
+    virtual int num_bindings() override { return 2; }
+    virtual bool is_input(int ibinding) override { return ibinding == 0; }
+    virtual bool set_run_dims(const std::string &name, const std::vector<int> &dims) override
+    {
+        return set_run_dims(index(name), dims);
+    }
+    virtual bool set_run_dims(int ibinding, const std::vector<int> &dims) override
+    {
+        // like the optimization profile, a batch above kMAX is refused
+        if (!dynamic_ || dims.empty() || dims[0] < 1 || dims[0] > max_batch_) return false;
+        batch_ = dims[0];
+        return true;
+    }
+    virtual TensorRT::DType dtype(const std::string &name) override { return TensorRT::DType::FLOAT; }
+    virtual TensorRT::DType dtype(int ibinding) override { return TensorRT::DType::FLOAT; }
+    virtual bool has_dynamic_dim() override { return dynamic_; }
+
+private:
+    bool run(const float *input, float *output)
+    {
+        for (int i = 0; i < batch_; ++i) output[i] = input[i] * 2 + 1;
+        batches.push_back(batch_);
+        return true;
+    }
+
+    int max_batch_;
+    bool dynamic_;
+    int batch_;
+};
+
+// num_tile tiles through an engine of max_batch, every tile has to come out of decode once and in order
+static bool check_rounds(FakeEngine &engine, int num_tile, const std::vector<int> &expect_batches)
+{
+    int max_batch = yolo::engine_max_batch(engine);
+    auto rounds = yolo::split_rounds(num_tile, max_batch);
+    std::vector<std::vector<int>> run_dims;
+    for (auto &round : rounds) run_dims.emplace_back(yolo::round_dims(engine, std::get<1>(round)));
+
+    // the buffers are sized for the largest batch only, like the device buffers of the model
+    std::vector<float> input(max_batch, -1), output(max_batch, -1);
+    std::vector<int> decoded;
+    bool ok = yolo::run_rounds(engine, rounds, run_dims, input.data(), output.data(),
+        [&](int ibegin, int num_round) {
+            if (num_round > max_batch) return false;
+            for (int i = 0; i < num_round; ++i) input[i] = (float)(ibegin + i);
+            return true;
+        },
+        [&](int ibegin, int num_round) {
+            for (int i = 0; i < num_round; ++i) decoded.push_back((int)((output[i] - 1) / 2));
+            return true;
+        });
+
+    bool passed = ok && (int)decoded.size() == num_tile && engine.batches == expect_batches;
+    for (int i = 0; passed && i < num_tile; ++i) passed = decoded[i] == i;
+    printf("max batch %d tiles %2d rounds %d decoded %d %s\n", max_batch, num_tile, (int)rounds.size(),
+           (int)decoded.size(), passed ? "ok" : "wrong");
+    return passed;
+}
+
+// more tiles than the profile allows go through the engine in several rounds
+void RoundsTest()
+{
+    bool passed = true;
+
+    // dynamic profile of kMAX 4, the last round is set to the 3 tiles left
+    FakeEngine dynamic_engine(4, true);
+    passed &= check_rounds(dynamic_engine, 11, {4, 4, 3});
+
+    // static batch 4 always runs full, the items past the round are ignored by decode
+    FakeEngine static_engine(4, false);
+    passed &= check_rounds(static_engine, 11, {4, 4, 4});
+
+    // fewer tiles than the profile is a single round
+    FakeEngine small_engine(16, true);
+    passed &= check_rounds(small_engine, 5, {5});
+
+    // a batch above kMAX is refused by the engine and stops the rounds
+    FakeEngine refused_engine(4, true);
+    std::vector<float> buffer(8);
+    auto noop = [](int, int) { return true; };
+    passed &= !yolo::run_rounds(refused_engine, {std::make_tuple(0, 8)}, {{8, 1}}, buffer.data(), buffer.data(), noop, noop);
+
+    printf("%s\n", passed ? "RoundsTest passed" : "RoundsTest FAILED");
+}
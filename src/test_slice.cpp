@@ -0,0 +1,79 @@
+#include "slice/slice.hpp"
+#include "common/check.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// materialized slices of image by the given backend, downloaded from the device
+static std::vector<uint8_t> slice_with(slice::SliceBackend backend, const tensor::Image &image,
+                                       int slice_width, int slice_height, float overlap_ratio)
+{
+    slice::SliceImage slicer;
+    slicer.mode_    = slice::SliceMode::Materialize;
+    slicer.backend_ = backend;
+    slicer.slice(image, slice_width, slice_height, overlap_ratio, overlap_ratio, nullptr);
+    checkRuntime(cudaDeviceSynchronize());
+
+    size_t bytes = (size_t)slicer.slice_num_h_ * slicer.slice_num_v_ * slice_width * slice_height * 3;
+    std::vector<uint8_t> slices(bytes);
+    checkRuntime(cudaMemcpy(slices.data(), slicer.output_images_.gpu(), bytes, cudaMemcpyDeviceToHost));
+    return slices;
+}
+
+static bool same_slices(const char *name, const tensor::Image &image, int slice_width, int slice_height, float overlap_ratio)
+{
+    std::vector<uint8_t> host   = slice_with(slice::SliceBackend::Host, image, slice_width, slice_height, overlap_ratio);
+    std::vector<uint8_t> device = slice_with(slice::SliceBackend::CUDA, image, slice_width, slice_height, overlap_ratio);
+    bool same = host.size() == device.size() && memcmp(host.data(), device.data(), host.size()) == 0;
+    printf("%-12s %4dx%-4d slices %4dx%-4d %s\n", name, image.width, image.height, slice_width, slice_height,
+           same ? "same" : "DIFFERENT");
+    return same;
+}
+
+static std::vector<uint8_t> random_bytes(size_t size)
+{
+    std::vector<uint8_t> bytes(size);
+    for (auto &b : bytes) b = rand() % 256;
+    return bytes;
+}
+
+// host backend against the cuda backend, byte for byte. slices larger than the frame are padded with 114
+void SliceHostTest()
+{
+    srand(23);
+    bool passed = true;
+
+    // odd sized bgr frames, the last one smaller than a slice in both directions
+    int sizes[][4] = {
+        {1001, 577, 640, 640},
+        {1919, 1081, 641, 383},
+        {333, 211, 400, 300},
+    };
+    for (auto &size : sizes)
+    {
+        int width = size[0], height = size[1];
+        std::vector<uint8_t> bgr = random_bytes((size_t)width * height * 3);
+        passed &= same_slices("bgr", tensor::Image(bgr.data(), width, height), size[2], size[3], 0.2f);
+    }
+
+    // bgr rows with padding
+    {
+        int width = 1001, height = 577, stride = width * 3 + 29;
+        std::vector<uint8_t> bgr = random_bytes((size_t)stride * height);
+        tensor::Image image(bgr.data(), width, height, tensor::PixelFormat::BGR, stride);
+        passed &= same_slices("bgr strided", image, 512, 512, 0.25f);
+    }
+
+    // nv12 with padded planes, converted on the host by one backend and on the device by the other
+    {
+        int width = 1002, height = 578, y_stride = 1024, uv_stride = 1040;
+        std::vector<uint8_t> luma = random_bytes((size_t)y_stride * height);
+        std::vector<uint8_t> uv   = random_bytes((size_t)uv_stride * (height / 2));
+        tensor::Image image = tensor::Image::nv12(luma.data(), y_stride, uv.data(), uv_stride, width, height);
+        passed &= same_slices("nv12", image, 640, 640, 0.2f);
+        passed &= same_slices("nv12", image, 300, 250, 0.2f);
+    }
+
+    printf("%s\n", passed ? "SliceHostTest passed" : "SliceHostTest FAILED");
+}
@@ -0,0 +1,116 @@
+#include "slice/slice.hpp"
+#include "slice/color.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// slice_kernel on the cpu, one pixel at a time: the slices start filled with const_value and every pixel of
+// the slice that lies inside the image is copied from it
+static std::vector<uint8_t> reference_slices(const uint8_t *image, const std::vector<int> &points,
+                                             int width, int height, int slice_width, int slice_height)
+{
+    int slice_num = (int)points.size() / 2;
+    std::vector<uint8_t> outs((size_t)slice_num * slice_width * slice_height * 3, 114);
+    for (int islice = 0; islice < slice_num; ++islice)
+    {
+        for (int y = 0; y < slice_height; ++y)
+        {
+            for (int x = 0; x < slice_width; ++x)
+            {
+                int dx = points[islice * 2] + x, dy = points[islice * 2 + 1] + y;
+                if (dx < 0 || dx >= width || dy < 0 || dy >= height) continue;
+                uint8_t *out = outs.data() + (((size_t)islice * slice_height + y) * slice_width + x) * 3;
+                memcpy(out, image + ((size_t)dy * width + dx) * 3, 3);
+            }
+        }
+    }
+    return outs;
+}
+
+static std::vector<uint8_t> random_bytes(size_t size)
+{
+    std::vector<uint8_t> bytes(size);
+    for (auto &b : bytes) b = rand() % 256;
+    return bytes;
+}
+
+static bool same_as_reference(const char *name, const tensor::Image &image, const uint8_t *bgr,
+                              const std::vector<int> &points, int slice_width, int slice_height)
+{
+    int slice_num = (int)points.size() / 2;
+    std::vector<uint8_t> expect = reference_slices(bgr, points, image.width, image.height, slice_width, slice_height);
+    std::vector<uint8_t> outs(expect.size(), 0);
+    slice::slice_image_host(image, outs.data(), points.data(), slice_width, slice_height, slice_num);
+    bool same = memcmp(outs.data(), expect.data(), expect.size()) == 0;
+    printf("%-12s %4dx%-4d slices %4dx%-4d x %2d %s\n", name, image.width, image.height, slice_width, slice_height,
+           slice_num, same ? "same" : "DIFFERENT");
+    return same;
+}
+
+// slice_plane_host and slice_image_host against a scalar copy of slice_kernel, byte for byte, without a device.
+// the grids keep their edge slices unshifted, so they run past the frame and get the 114 border
+void SlicePlaneHostTest()
+{
+    srand(29);
+    bool passed = true;
+
+    // odd sized bgr frames, the last one smaller than a slice in both directions
+    int sizes[][4] = {
+        {1001, 577, 640, 640},
+        {1919, 1081, 641, 383},
+        {333, 211, 400, 300},
+        {7, 5, 3, 3},
+    };
+    for (auto &size : sizes)
+    {
+        int width = size[0], height = size[1], slice_width = size[2], slice_height = size[3];
+        std::vector<uint8_t> bgr = random_bytes((size_t)width * height * 3);
+        int num_h = 0, num_v = 0;
+        std::vector<int> points = slice::calculateSliceStartPoints(
+            width, height, slice_width, slice_height, 0.2f, 0.2f, num_h, num_v, false);
+
+        // start points outside the frame on every side, the whole slice or a part of it is border
+        points.insert(points.end(), {-5, -7, width - 2, height - 1, -slice_width, 0, width, height});
+
+        std::vector<uint8_t> expect = reference_slices(bgr.data(), points, width, height, slice_width, slice_height);
+        std::vector<uint8_t> outs(expect.size(), 0);
+        slice::slice_plane_host(bgr.data(), outs.data(), points.data(), width, height,
+                                slice_width, slice_height, (int)points.size() / 2);
+        bool same = memcmp(outs.data(), expect.data(), expect.size()) == 0;
+        printf("%-12s %4dx%-4d slices %4dx%-4d x %2d %s\n", "plane", width, height, slice_width, slice_height,
+               (int)points.size() / 2, same ? "same" : "DIFFERENT");
+        passed &= same;
+
+        passed &= same_as_reference("bgr", tensor::Image(bgr.data(), width, height), bgr.data(), points,
+                                    slice_width, slice_height);
+    }
+
+    // bgr rows with padding, compacted before the crop
+    {
+        int width = 1001, height = 577, stride = width * 3 + 29;
+        std::vector<uint8_t> padded = random_bytes((size_t)stride * height);
+        std::vector<uint8_t> bgr((size_t)width * height * 3);
+        for (int y = 0; y < height; ++y)
+            memcpy(bgr.data() + (size_t)y * width * 3, padded.data() + (size_t)y * stride, (size_t)width * 3);
+        int num_h = 0, num_v = 0;
+        std::vector<int> points = slice::calculateSliceStartPoints(width, height, 512, 512, 0.25f, 0.25f, num_h, num_v, false);
+        tensor::Image image(padded.data(), width, height, tensor::PixelFormat::BGR, stride);
+        passed &= same_as_reference("bgr strided", image, bgr.data(), points, 512, 512);
+    }
+
+    // nv12 with padded planes, converted to bgr on the host before the crop
+    {
+        int width = 1002, height = 578, y_stride = 1024, uv_stride = 1040;
+        std::vector<uint8_t> luma = random_bytes((size_t)y_stride * height);
+        std::vector<uint8_t> uv   = random_bytes((size_t)uv_stride * (height / 2));
+        tensor::Image image = tensor::Image::nv12(luma.data(), y_stride, uv.data(), uv_stride, width, height);
+        std::vector<uint8_t> bgr((size_t)width * height * 3);
+        slice::convert_to_bgr_host(image, bgr.data());
+        int num_h = 0, num_v = 0;
+        std::vector<int> points = slice::calculateSliceStartPoints(width, height, 300, 250, 0.2f, 0.2f, num_h, num_v, false);
+        passed &= same_as_reference("nv12", image, bgr.data(), points, 300, 250);
+    }
+
+    printf("%s\n", passed ? "SlicePlaneHostTest passed" : "SlicePlaneHostTest FAILED");
+}
@@ -22,8 +22,12 @@ class TrtSahiYolo:
         ...
     def autoSliceForward(self, image: numpy.ndarray) -> list[Box]:
         ...
+    def autoSlicePrepare(self, width: int, height: int) -> bool:
+        ...
     def manualSliceForward(self, image: numpy.ndarray, width: int, height: int, xratio: float, yratio: float) -> list[Box]:
         ...
+    def manualSlicePrepare(self, width: int, height: int, slice_width: int, slice_height: int, xratio: float, yratio: float) -> bool:
+        ...
     @property
     def valid(self) -> bool:
         ...